@@ -4,11 +4,15 @@
 #include "main.h"
 #include "hd.h"
 #include "bd.h"
+#include "exportplan.h"
 #include <QString>
 
 class Sf2Exporter {
 public:
-    static bool exportToSf2(const QString& path, const Bank& bank, BDParser* bd);
+    static bool exportToSf2(const QString& path, const Bank& bank, const BDParser* bd, ExportStats* stats = nullptr);
+    // Several banks merged into one file, each under its own bank number. Samples
+    // shared between them are stored once.
+    static bool exportBanksToSf2(const QString& path, const std::vector<ExportBank>& banks, ExportStats* stats = nullptr);
 };
 
 #endif // S2SF2_H
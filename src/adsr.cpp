@@ -0,0 +1,240 @@
+#include "adsr.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+// --- VolumeEnvelope Implementation ---
+
+void VolumeEnvelope::Reset(u8 rate_, u8 rate_mask_, bool decreasing_, bool exponential_, bool phase_invert_) {
+    rate = rate_;
+    decreasing = decreasing_;
+    exponential = exponential_;
+    phase_invert = phase_invert_ && !(decreasing_ && exponential_);
+    counter = 0;
+    counter_increment = 0x8000;
+
+    const s16 base_step = 7 - (rate & 3);
+    step = ((decreasing_ ^ phase_invert_) | (decreasing_ & exponential_)) ? ~base_step : base_step;
+
+    if (rate < 44) {
+        step <<= (11 - (rate >> 2));
+    }
+    else if (rate >= 48) {
+        counter_increment >>= ((rate >> 2) - 11);
+        if ((rate & rate_mask_) != rate_mask_)
+            counter_increment = std::max<u16>(counter_increment, 1u);
+    }
+}
+
+bool VolumeEnvelope::Tick(s16& current_level) {
+    u32 this_increment = counter_increment;
+    s32 this_step = step;
+
+    if (exponential) {
+        if (decreasing) this_step = (this_step * current_level) >> 15;
+        else {
+            if (current_level >= 0x6000) {
+                if (rate < 40) this_step >>= 2;
+                else if (rate >= 44) this_increment >>= 2;
+                else { this_step >>= 1; this_increment >>= 1; }
+            }
+        }
+    }
+
+    counter += this_increment;
+    if (!(counter & 0x8000)) return true;
+
+    counter = 0;
+    s32 new_level = current_level + this_step;
+
+    if (!decreasing) {
+        if (new_level < -32768) new_level = -32768;
+        if (new_level > 32767) new_level = 32767;
+        current_level = (s16)new_level;
+        return (new_level != ((this_step < 0) ? -32768 : 32767));
+    } else {
+        if (phase_invert) {
+            if (new_level < -32768) new_level = -32768;
+            if (new_level > 0) new_level = 0;
+        }
+        else {
+            if (new_level < 0) new_level = 0;
+        }
+        current_level = (s16)new_level;
+        return (new_level == 0);
+    }
+}
+
+void HardwareADSR::KeyOn() {
+    current_volume = 0;
+    phase = Phase::Attack;
+    UpdateEnvelope();
+}
+
+void HardwareADSR::KeyOff() {
+    if (phase == Phase::Off || phase == Phase::Release) return;
+    phase = Phase::Release;
+    UpdateEnvelope();
+}
+
+void HardwareADSR::UpdateEnvelope() {
+    u32 sustain_level = get_bits(reg_val, 0, 4);
+    u32 decay_shift = get_bits(reg_val, 4, 4);
+    u32 attack_step = get_bits(reg_val, 8, 2);
+    u32 attack_shift = get_bits(reg_val, 10, 5);
+    bool attack_exp = get_bits(reg_val, 15, 1);
+    u32 release_shift = get_bits(reg_val, 16, 5);
+    bool release_exp = get_bits(reg_val, 21, 1);
+    u32 sustain_step = get_bits(reg_val, 22, 2);
+    u32 sustain_shift = get_bits(reg_val, 24, 5);
+    bool sustain_dec = get_bits(reg_val, 30, 1);
+    bool sustain_exp = get_bits(reg_val, 31, 1);
+
+    u8 attack_rate = (attack_shift << 2) | attack_step;
+    u8 decay_rate = (decay_shift << 2);
+    u8 sustain_rate = (sustain_shift << 2) | sustain_step;
+    u8 release_rate = (release_shift << 2);
+
+    switch(phase) {
+        case Phase::Off:
+            target_volume = 0;
+            envelope.Reset(0, 0, false, false, false);
+            break;
+        case Phase::Attack:
+            target_volume = 32767;
+            envelope.Reset(attack_rate, 0x7F, false, attack_exp, false);
+            break;
+        case Phase::Decay:
+            target_volume = (s16)std::min<s32>((sustain_level + 1) * 0x800, 32767);
+            envelope.Reset(decay_rate, 0x1F << 2, true, true, false);
+            break;
+        case Phase::Sustain:
+            target_volume = 0;
+            envelope.Reset(sustain_rate, 0x7F, sustain_dec, sustain_exp, false);
+            break;
+        case Phase::Release:
+            target_volume = 0;
+            envelope.Reset(release_rate, 0x1F << 2, true, release_exp, false);
+            break;
+    }
+}
+
+s16 HardwareADSR::Tick() {
+    if (phase == Phase::Off) return 0;
+
+    if (envelope.counter_increment > 0)
+        envelope.Tick(current_volume);
+
+    if (phase != Phase::Sustain) {
+        bool reached = envelope.decreasing ? (current_volume <= target_volume) : (current_volume >= target_volume);
+        if (reached) {
+            if (phase == Phase::Attack) phase = Phase::Decay;
+            else if (phase == Phase::Decay) phase = Phase::Sustain;
+            else if (phase == Phase::Release) phase = Phase::Off;
+            UpdateEnvelope();
+        }
+    }
+    return current_volume;
+}
+
+int16_t HardwareADSR::simulate_timecents(u32 reg_val, Phase target_phase) {
+    HardwareADSR sim(reg_val);
+    sim.phase = target_phase;
+    sim.current_volume = (target_phase == Phase::Attack) ? 0 : 32767;
+    sim.UpdateEnvelope();
+
+    if (sim.envelope.counter_increment == 0) return -32768; // Instant/Zero duration
+
+    int samples = 0;
+    int limit = 44100 * 15;
+
+    while (samples < limit) {
+        sim.envelope.Tick(sim.current_volume);
+
+        bool finished = false;
+        if (target_phase == Phase::Attack) {
+            finished = (sim.current_volume >= 32767);
+        } else {
+            // For Decay/Release/Sustain
+            if (target_phase == Phase::Decay) {
+                // Decay finishes when it hits sustain level
+                finished = (sim.current_volume <= sim.target_volume);
+            } else {
+                finished = (sim.current_volume <= 0);
+            }
+        }
+
+        if (finished) break;
+        samples++;
+    }
+
+    if (samples <= 1) return -32768;
+
+    double seconds = (double)samples / 44100.0;
+    if (seconds < 0.001) return -32768;
+
+    return static_cast<int16_t>(1200.0 * std::log2(seconds));
+}
+
+// --- Inverse tables ---
+
+namespace {
+struct RateTables {
+    s16 attack[128];      // (shift << 2) | step, linear
+    s16 decay[16][16];    // [sustain level][shift], decay stops at the sustain level
+    s16 release[32];      // shift, exponential
+};
+}
+
+// Register fields used by nearest_register
+static const u32 RELEASE_EXP = 1u << 21;
+static const u32 SUSTAIN_HOLD = (3u << 22) | (0x1Fu << 24); // increasing at the slowest rate
+
+static const RateTables& rate_tables() {
+    static RateTables t;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        for (u32 r = 0; r < 128; ++r)
+            t.attack[r] = HardwareADSR::simulate_timecents(r << 8, HardwareADSR::Phase::Attack);
+        for (u32 sl = 0; sl < 16; ++sl)
+            for (u32 d = 0; d < 16; ++d)
+                t.decay[sl][d] = HardwareADSR::simulate_timecents(sl | (d << 4), HardwareADSR::Phase::Decay);
+        for (u32 r = 0; r < 32; ++r)
+            t.release[r] = HardwareADSR::simulate_timecents(RELEASE_EXP | (r << 16), HardwareADSR::Phase::Release);
+    });
+    return t;
+}
+
+// SF2 treats anything at or under -12000 as instant, so does the simulator's -32768
+static int tc_distance(s16 a, s16 b) {
+    return std::abs(std::max<int>(a, -12000) - std::max<int>(b, -12000));
+}
+
+static u32 nearest(const s16* table, u32 count, s16 tc) {
+    u32 best = 0;
+    for (u32 i = 1; i < count; ++i) {
+        if (tc_distance(table[i], tc) < tc_distance(table[best], tc)) best = i;
+    }
+    return best;
+}
+
+u32 HardwareADSR::nearest_register(s16 attack_tc, s16 decay_tc, u16 sustain_cb, s16 release_tc) {
+    const RateTables& t = rate_tables();
+
+    // Same level mapping the export uses: 66 cB per step, level 0 as 1440
+    u32 sl = 0;
+    int bestDist = 1 << 30;
+    for (u32 l = 0; l < 16; ++l) {
+        int cb = l == 0 ? 1440 : (int)(15 - l) * 66;
+        if (std::abs(cb - (int)sustain_cb) < bestDist) {
+            bestDist = std::abs(cb - (int)sustain_cb);
+            sl = l;
+        }
+    }
+
+    u32 attack = nearest(t.attack, 128, attack_tc);
+    u32 decay = nearest(t.decay[sl], 16, decay_tc);
+    u32 release = nearest(t.release, 32, release_tc);
+    return sl | (decay << 4) | (attack << 8) | (release << 16) | RELEASE_EXP | SUSTAIN_HOLD;
+}
@@ -0,0 +1,50 @@
+#ifndef ADSR_H
+#define ADSR_H
+
+#include "main.h"
+
+// Kill me. ported from apeplayer
+
+static inline uint32_t get_bits(uint32_t val, int start, int len) {
+    return (val >> start) & ((1 << len) - 1);
+}
+
+struct VolumeEnvelope {
+    u8 rate;
+    bool decreasing;
+    bool exponential;
+    bool phase_invert;
+    s32 counter;
+    s32 counter_increment;
+    s32 step;
+
+    void Reset(u8 rate_, u8 rate_mask_, bool decreasing_, bool exponential_, bool phase_invert_);
+    bool Tick(s16& current_level);
+};
+
+class HardwareADSR {
+public:
+    enum class Phase { Attack, Decay, Sustain, Release, Off };
+
+    u32 reg_val;
+    Phase phase;
+    s16 current_volume;
+    s16 target_volume;
+    VolumeEnvelope envelope;
+
+    HardwareADSR(u32 val) : reg_val(val), phase(Phase::Off), current_volume(0), target_volume(0) {}
+
+    void KeyOn();
+    void KeyOff();
+    void UpdateEnvelope();
+    s16 Tick();
+
+    // Static simulator for SF2 timecent conversion
+    static int16_t simulate_timecents(u32 reg_val, Phase target_phase);
+    // The other way: register whose simulated times land nearest the SF2 ones (timecents,
+    // sustain as attenuation in cB). Linear attack, exponential release, sustain held.
+    // Tables of every rate are simulated once per process on first use.
+    static u32 nearest_register(s16 attack_tc, s16 decay_tc, u16 sustain_cb, s16 release_tc);
+};
+
+#endif // ADSR_H
@@ -0,0 +1,82 @@
+#include "audiostats.h"
+#include <algorithm>
+#include <fstream>
+
+void AudioStats::reset() {
+    last_start_ns.store(0, std::memory_order_relaxed);
+    callbacks.store(0, std::memory_order_relaxed);
+    overruns.store(0, std::memory_order_relaxed);
+    xruns.store(0, std::memory_order_relaxed);
+    underruns.store(0, std::memory_order_relaxed);
+    silence_frames.store(0, std::memory_order_relaxed);
+    last_load.store(0, std::memory_order_relaxed);
+    peak_load.store(0, std::memory_order_relaxed);
+    for (auto& b : histogram) b.store(0, std::memory_order_relaxed);
+}
+
+void AudioStats::record(Clock::time_point start, u32 frames, u32 silence, bool underrun) {
+    s64 start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    s64 took_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    u32 rate = sample_rate.load(std::memory_order_relaxed);
+    if (rate == 0 || frames == 0) return;
+
+    s64 period_ns = (s64)frames * 1000000000LL / rate;
+    if (period_ns <= 0) return;
+
+    callbacks.fetch_add(1, std::memory_order_relaxed);
+    if (took_ns > period_ns) overruns.fetch_add(1, std::memory_order_relaxed);
+    if (underrun) underruns.fetch_add(1, std::memory_order_relaxed);
+    if (silence) silence_frames.fetch_add(silence, std::memory_order_relaxed);
+
+    // Device asks for the next period right after the previous one, so a gap well past
+    // one period means the OS or the driver let the buffer run dry
+    s64 prev = last_start_ns.exchange(start_ns, std::memory_order_relaxed);
+    if (prev != 0 && (start_ns - prev) > period_ns * 3 / 2)
+        xruns.fetch_add(1, std::memory_order_relaxed);
+
+    u32 load = (u32)std::min<s64>(took_ns * 1000 / period_ns, 0xFFFFFFFF);
+    last_load.store(load, std::memory_order_relaxed);
+    u32 peak = peak_load.load(std::memory_order_relaxed);
+    while (load > peak && !peak_load.compare_exchange_weak(peak, load, std::memory_order_relaxed)) {}
+
+    int bucket = (int)std::min<s64>(took_ns * 8 / period_ns, BUCKETS - 1);
+    histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+AudioStats::Snapshot AudioStats::snapshot() const {
+    Snapshot s;
+    s.callbacks = callbacks.load(std::memory_order_relaxed);
+    s.overruns = overruns.load(std::memory_order_relaxed);
+    s.xruns = xruns.load(std::memory_order_relaxed);
+    s.underruns = underruns.load(std::memory_order_relaxed);
+    s.silence_frames = silence_frames.load(std::memory_order_relaxed);
+    s.last_load = last_load.load(std::memory_order_relaxed);
+    s.peak_load = peak_load.load(std::memory_order_relaxed);
+    for (int i = 0; i < BUCKETS; ++i) s.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+    return s;
+}
+
+bool AudioStats::dump(const std::string& path) const {
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+        LogErr("Could not write audio stats: " + path);
+        return false;
+    }
+
+    Snapshot s = snapshot();
+    ofs << "callbacks      " << s.callbacks << "\n"
+        << "overruns       " << s.overruns << "\n"
+        << "xruns          " << s.xruns << "\n"
+        << "underruns      " << s.underruns << "\n"
+        << "silence_frames " << s.silence_frames << "\n"
+        << "last_load      " << s.last_load / 10.0 << "%\n"
+        << "peak_load      " << s.peak_load / 10.0 << "%\n"
+        << "\n# callback duration, fraction of buffer period\n";
+
+    for (int i = 0; i < BUCKETS; ++i) {
+        if (i == BUCKETS - 1) ofs << ">= " << (i / 8.0) << "      ";
+        else ofs << std::fixed << std::setprecision(3) << (i / 8.0) << "-" << ((i + 1) / 8.0) << " ";
+        ofs << s.histogram[i] << "\n";
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef AUDIOSTATS_H
+#define AUDIOSTATS_H
+
+#include "main.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Callback timing for the preview device. The audio thread only touches
+// fixed atomics (no locks, no allocation), the GUI reads snapshots.
+class AudioStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Histogram of callback duration in 1/8ths of the buffer period, last bucket is >= 2x
+    static const int BUCKETS = 17;
+
+    struct Snapshot {
+        u64 callbacks = 0;
+        u64 overruns = 0;       // callback took longer than its own period
+        u64 xruns = 0;          // callback arrived late enough that the device likely starved
+        u64 underruns = 0;      // we had nothing ready while still playing
+        u64 silence_frames = 0; // padded while playing, idle callbacks are not recorded
+        u32 last_load = 0;      // permille of the period
+        u32 peak_load = 0;
+        u32 histogram[BUCKETS] = {};
+    };
+
+    void reset();
+    void set_sample_rate(u32 rate) { sample_rate.store(rate, std::memory_order_relaxed); }
+    // Device stopped on purpose, the next callback gap is not an xrun
+    void mark_stopped() { last_start_ns.store(0, std::memory_order_relaxed); }
+
+    // Audio thread
+    void record(Clock::time_point start, u32 frames, u32 silence, bool underrun);
+
+    Snapshot snapshot() const;
+    bool dump(const std::string& path) const;
+
+private:
+    std::atomic<u32> sample_rate{44100};
+    std::atomic<s64> last_start_ns{0};
+    std::atomic<u64> callbacks{0};
+    std::atomic<u64> overruns{0};
+    std::atomic<u64> xruns{0};
+    std::atomic<u64> underruns{0};
+    std::atomic<u64> silence_frames{0};
+    std::atomic<u32> last_load{0};
+    std::atomic<u32> peak_load{0};
+    std::atomic<u32> histogram[BUCKETS] = {};
+};
+
+#endif // AUDIOSTATS_H
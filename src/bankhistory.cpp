@@ -0,0 +1,70 @@
+#include "bankhistory.h"
+
+void BankHistory::apply(Bank& bank, Bank next) {
+    undos.push_back(std::move(bank));
+    if (undos.size() > MAX_STEPS) undos.pop_front();
+    redos.clear();
+    bank = std::move(next);
+}
+
+bool BankHistory::undo(Bank& bank) {
+    if (undos.empty()) return false;
+    redos.push_back(std::move(bank));
+    bank = std::move(undos.back());
+    undos.pop_back();
+    return true;
+}
+
+bool BankHistory::redo(Bank& bank) {
+    if (redos.empty()) return false;
+    undos.push_back(std::move(bank));
+    bank = std::move(redos.back());
+    redos.pop_back();
+    return true;
+}
+
+void BankHistory::clear() {
+    undos.clear();
+    redos.clear();
+}
+
+static int find_program(const Bank& bank, u32 prog_id) {
+    for (size_t i = 0; i < bank.programs.size(); ++i) {
+        if (bank.programs[i] && bank.programs[i]->id == prog_id) return (int)i;
+    }
+    return -1;
+}
+
+bool BankHistory::with_tone(const Bank& bank, u32 prog_id, size_t tone_idx, const Tone& tone, Bank& out) {
+    int at = find_program(bank, prog_id);
+    if (at < 0 || tone_idx >= bank.programs[at]->tones.size()) return false;
+
+    auto prog = std::make_shared<Program>(*bank.programs[at]);
+    // The key range belongs to the split, every tone read from it follows
+    const Tone& old = prog->tones[tone_idx];
+    if (old.src_split != Tone::NO_SOURCE && (old.min_note != tone.min_note || old.max_note != tone.max_note)) {
+        u8 split = old.src_split;
+        for (size_t i = 0; i < prog->tones.size(); ++i) {
+            if (i == tone_idx || prog->tones[i].src_split != split) continue;
+            Tone& t = prog->tones.edit(i);
+            t.min_note = tone.min_note;
+            t.max_note = tone.max_note;
+        }
+    }
+    prog->tones.edit(tone_idx) = tone;
+    out = bank;
+    out.programs.edit(at) = std::move(prog);
+    return true;
+}
+
+bool BankHistory::with_program(const Bank& bank, u32 prog_id, u8 master_vol, u8 master_pan, Bank& out) {
+    int at = find_program(bank, prog_id);
+    if (at < 0) return false;
+
+    auto prog = std::make_shared<Program>(*bank.programs[at]);
+    prog->master_vol = master_vol;
+    prog->master_pan = master_pan;
+    out = bank;
+    out.programs.edit(at) = std::move(prog);
+    return true;
+}
@@ -0,0 +1,40 @@
+#ifndef BANKHISTORY_H
+#define BANKHISTORY_H
+
+#include "main.h"
+#include "hd.h"
+#include <deque>
+#include <vector>
+
+// Undo/redo for one bank. Every step keeps the whole Bank value, which costs two
+// pointers since programs and tone arrays are shared copy-on-write; undo and redo
+// just swap which root is current.
+class BankHistory {
+public:
+    // Oldest steps are dropped past this
+    static const size_t MAX_STEPS = 4096;
+
+    // Replaces bank with next, keeping the old root for undo. Clears the redo side.
+    void apply(Bank& bank, Bank next);
+    bool undo(Bank& bank);
+    bool redo(Bank& bank);
+    void clear();
+
+    bool can_undo() const { return !undos.empty(); }
+    bool can_redo() const { return !redos.empty(); }
+    size_t steps() const { return undos.size(); }
+
+    // Copy of bank with one tone replaced. Only the program and the chunks of the program
+    // list and tone array that hold the edit are new, everything else stays shared. A new key
+    // range goes to every tone of the same split, the HD keeps one range per split.
+    // False if the program or tone does not exist.
+    static bool with_tone(const Bank& bank, u32 prog_id, size_t tone_idx, const Tone& tone, Bank& out);
+    // Same for the program's own settings
+    static bool with_program(const Bank& bank, u32 prog_id, u8 master_vol, u8 master_pan, Bank& out);
+
+private:
+    std::deque<Bank> undos;
+    std::vector<Bank> redos;
+};
+
+#endif // BANKHISTORY_H
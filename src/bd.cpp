@@ -2,6 +2,7 @@
 #include <fstream>
 #include <cstring>
 #include <string>
+#include <algorithm>
 
 static const double F0[] = {0.0, 0.9375, 1.796875, 1.53125, 1.90625};
 static const double F1[] = {0.0, 0.0, -0.8125, -0.859375, -0.9375};
@@ -21,6 +22,7 @@ bool BDParser::load(const QString& path) {
         return false;
     }
 
+    view(nullptr, nullptr, 0);
     data.resize(size);
     file.seekg(0);
     file.read(reinterpret_cast<char*>(data.data()), data.size());
@@ -29,69 +31,97 @@ bool BDParser::load(const QString& path) {
     return true;
 }
 
-std::vector<u8> BDParser::get_adpcm_block(u32 start_offset) {
-    if (start_offset >= data.size()) {
-        LogErr("Offset out of bounds: " + std::to_string(start_offset));
-        return {};
-    }
+static inline u64 load_u64(const u8* p) {
+    u64 v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
 
-    std::vector<u8> raw_blocks;
-    size_t cursor = start_offset;
+// Bytes from start_offset up to and including the end block (end flag or the silence
+// hack), capped at 4MB. The content hash rides along on the same pass, two multiplies
+// per block, so deduplication costs nothing beyond finding the boundary.
+SampleSpan BDParser::scan_sample(u32 start_offset) const {
+    SampleSpan span;
+    span.offset = start_offset;
+    if (start_offset >= size()) return span;
+
+    const u64 K1 = 0x9E3779B97F4A7C15ull, K2 = 0xC2B2AE3D27D4EB4Full;
+    u64 h = 0x27D4EB2F165667C5ull;
 
-    while (true) {
-        if (cursor + 16 > data.size()) break;
+    size_t cursor = start_offset;
+    while (cursor + 16 <= size()) {
+        const u8* blk = bytes((u32)cursor);
+        u8 flags = blk[1];
 
-        size_t current_size = raw_blocks.size();
-        raw_blocks.resize(current_size + 16);
-        std::memcpy(raw_blocks.data() + current_size, data.data() + cursor, 16);
+        h = (h ^ load_u64(blk)) * K1;
+        h = ((h << 31) | (h >> 33)) ^ load_u64(blk + 8);
+        h *= K2;
 
-        u8 flags = data[cursor + 1];
+        if (flags & 2) span.looping = true;
 
         // Silence Loop Hack
-        bool isSilenceEnd = false;
-        if (cursor + 16 <= data.size()) {
-            if (data[cursor] == 0x00 && data[cursor+1] == 0x07 && data[cursor+2] == 0x77) {
-                isSilenceEnd = true;
-            }
-        }
+        bool isSilenceEnd = blk[0] == 0x00 && blk[1] == 0x07 && blk[2] == 0x77;
 
         cursor += 16;
         if ((flags & 1) || isSilenceEnd) break;
-        if (raw_blocks.size() > 4 * 1024 * 1024) break;
+        if (cursor - start_offset > 4 * 1024 * 1024) break;
     }
-    return raw_blocks;
+
+    span.size = (u32)(cursor - start_offset);
+    h ^= span.size;
+    h ^= h >> 29;
+    h *= K1;
+    h ^= h >> 32;
+    span.hash = h;
+    return span;
 }
 
-DecodedSample BDParser::decode_adpcm(const std::vector<u8>& adpcm_data, u32 sample_rate) {
-    DecodedSample result;
-    result.sample_rate = sample_rate;
+std::vector<u8> BDParser::get_adpcm_block(u32 start_offset) const {
+    if (start_offset >= size()) {
+        LogErr("Offset out of bounds: " + std::to_string(start_offset));
+        return {};
+    }
 
-    if (adpcm_data.empty()) return result;
+    const u8* begin = bytes(start_offset);
+    return std::vector<u8>(begin, begin + scan_sample(start_offset).size);
+}
 
-    std::vector<s16> samples;
-    double s1 = 0, s2 = 0;
-    int num_blocks = adpcm_data.size() / 16;
-    samples.reserve(num_blocks * 28);
+static inline bool is_silence_hack(const u8* blk) {
+    return blk[0] == 0x00 && blk[1] == 0x07 && blk[2] == 0x77;
+}
+
+AdpcmDecoder::AdpcmDecoder(const u8* data_, size_t size, u32 sample_rate) : data(data_), num_blocks(size / 16) {
+    layout.sample_rate = sample_rate;
+
+    // Same rules the decode loop used to apply inline, just without touching the nibbles
+    for (size_t b = 0; b < num_blocks; b++) {
+        const u8* blk = data + b * 16;
+        u8 flags = blk[1];
+        u32 pos = (u32)(b * 28);
+
+        if ((flags & 4)) layout.loop_start = pos;
+        if ((flags & 2)) layout.looping = true;
+        if (((flags & 1) || is_silence_hack(blk)) && layout.looping) {
+            layout.loop_end = pos + 28;
+        }
+    }
+    if (layout.loop_end == 0) layout.loop_end = (u32)total_samples();
+}
+
+size_t AdpcmDecoder::decode(s16* out, size_t max_blocks) {
+    size_t written = 0;
+    size_t end = std::min(num_blocks, block + max_blocks);
 
-    for (int b = 0; b < num_blocks; b++) {
-        int offset = b * 16;
-        u8 shift_filter = adpcm_data[offset];
-        u8 flags = adpcm_data[offset+1];
+    for (; block < end; block++) {
+        const u8* blk = data + block * 16;
+        u8 shift_filter = blk[0];
 
         int shift = 12 - (shift_filter & 0x0F);
         int filter_idx = (shift_filter >> 4) & 0x07;
         if (filter_idx > 4) filter_idx = 0;
 
-        bool isSilenceHack = (shift_filter == 0x00 && flags == 0x07 && adpcm_data[offset+2] == 0x77);
-
-        if ((flags & 4)) result.loop_start = (u32)samples.size();
-        if ((flags & 2)) result.looping = true;
-        if (((flags & 1) || isSilenceHack) && result.looping) {
-            result.loop_end = (u32)samples.size() + 28;
-        }
-
         for (int i = 2; i < 16; i++) {
-            u8 byte = adpcm_data[offset + i];
+            u8 byte = blk[i];
             int nibbles[2] = { byte & 0x0F, (byte >> 4) & 0x0F };
 
             for (int nib : nibbles) {
@@ -105,12 +135,20 @@ DecodedSample BDParser::decode_adpcm(const std::vector<u8>& adpcm_data, u32 samp
 
                 if (val > 32767.0) val = 32767.0;
                 if (val < -32768.0) val = -32768.0;
-                samples.push_back((s16)val);
+                out[written++] = (s16)val;
             }
         }
     }
+    return written;
+}
+
+DecodedSample BDParser::decode_adpcm(const std::vector<u8>& adpcm_data, u32 sample_rate) {
+    AdpcmDecoder dec(adpcm_data.data(), adpcm_data.size(), sample_rate);
+    DecodedSample result = dec.info();
+    if (adpcm_data.empty()) return result;
 
-    if (result.loop_end == 0) result.loop_end = (u32)samples.size();
-    result.pcm = samples;
+    auto pcm = std::make_shared<std::vector<s16>>(dec.total_samples());
+    dec.decode(pcm->data(), adpcm_data.size() / 16);
+    result.pcm = std::move(pcm);
     return result;
 }
@@ -4,23 +4,78 @@
 #include "main.h"
 #include <QString>
 #include <vector>
+#include <memory>
+
+// Decoded PCM is written once and then only ever read, so everyone holds the same buffer
+using PcmBuffer = std::shared_ptr<const std::vector<s16>>;
 
 struct DecodedSample {
-    std::vector<s16> pcm;
+    PcmBuffer pcm;
     u32 loop_start = 0;
     u32 loop_end = 0;
     bool looping = false;
     u32 sample_rate = 44100;
 };
 
+// Where a sample's ADPCM run ends and what it holds. Equal data hashes equal
+// whatever the offset or bank, so the hash works as a content address.
+struct SampleSpan {
+    u32 offset = 0;
+    u32 size = 0;   // bytes, end block included
+    u64 hash = 0;
+    bool looping = false; // any block carries the repeat flag
+};
+
+// Block-by-block decoder over raw ADPCM, for callers that want samples before the
+// whole run is decoded. Loop points come from a flag pre-scan so they are known up front.
+class AdpcmDecoder {
+public:
+    AdpcmDecoder(const u8* data, size_t size, u32 sample_rate);
+
+    // Loop points and rate, pcm left empty
+    const DecodedSample& info() const { return layout; }
+    size_t total_samples() const { return num_blocks * 28; }
+    bool finished() const { return block >= num_blocks; }
+
+    // Decodes up to max_blocks more blocks into out, returns samples written
+    size_t decode(s16* out, size_t max_blocks);
+
+private:
+    const u8* data;
+    size_t num_blocks;
+    size_t block = 0;
+    double s1 = 0, s2 = 0;
+    DecodedSample layout;
+};
+
 class BDParser {
 public:
     bool load(const QString& path);
-    std::vector<u8> get_adpcm_block(u32 start_offset);
+    // ADPCM built in memory (encoder output) instead of read from a file
+    void assign(std::vector<u8> bytes) { data = std::move(bytes); view(nullptr, nullptr, 0); }
+    // Bytes that live elsewhere (a region of a mapped disc image), owner keeps them valid
+    void view(std::shared_ptr<const void> owner, const u8* bytes, size_t size) {
+        view_owner = std::move(owner);
+        view_data = bytes;
+        view_size = size;
+    }
+    size_t size() const { return view_data ? view_size : data.size(); }
+    std::vector<u8> get_adpcm_block(u32 start_offset) const;
+    // Same run as get_adpcm_block, without the copy. Valid until the next load().
+    SampleSpan scan_sample(u32 start_offset) const;
+    size_t block_run(u32 start_offset) const { return scan_sample(start_offset).size; }
+    // Null at or past the end, check before reading
+    const u8* bytes(u32 start_offset) const {
+        if (start_offset >= size()) return nullptr;
+        return (view_data ? view_data : data.data()) + start_offset;
+    }
     static DecodedSample decode_adpcm(const std::vector<u8>& adpcm_data, u32 sample_rate);
 
 private:
     std::vector<u8> data;
+    std::shared_ptr<const void> view_owner;
+    const u8* view_data = nullptr;
+    size_t view_size = 0;
 };
 
 #endif // BD_H
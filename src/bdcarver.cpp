@@ -0,0 +1,121 @@
+#include "bdcarver.h"
+#include "adsr.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <cstring>
+
+// Block classes
+enum : u8 {
+    BLK_VALID = 1,
+    BLK_END = 2,        // end flag or the silence hack
+    BLK_REPEAT = 4,
+    BLK_LOOP_START = 8,
+    BLK_SIGNAL = 16,    // any nibble non-zero
+};
+
+// Blocks per classification task, 64K blocks = 1MB of BD
+static const size_t CHUNK_BLOCKS = 1 << 16;
+// Shorter runs are mostly padding or noise that happens to validate
+static const size_t MIN_BLOCKS = 2;
+// Same cap as scan_sample
+static const size_t MAX_BYTES = 4 * 1024 * 1024;
+
+static inline u8 classify(const u8* blk) {
+    u8 filter = blk[0] >> 4, shift = blk[0] & 0x0F, flags = blk[1];
+    if (filter > 4 || shift > 12 || flags > 7) return 0;
+
+    u8 c = BLK_VALID;
+    bool silenceHack = blk[0] == 0x00 && blk[1] == 0x07 && blk[2] == 0x77;
+    if ((flags & 1) || silenceHack) c |= BLK_END;
+    if (flags & 2) c |= BLK_REPEAT;
+    if (flags & 4) c |= BLK_LOOP_START;
+
+    u64 a, b;
+    std::memcpy(&a, blk, 8);
+    std::memcpy(&b, blk + 8, 8);
+    if ((a >> 16) | b) c |= BLK_SIGNAL;
+    return c;
+}
+
+std::vector<CarvedSample> BdCarver::scan(const BDParser& bd, size_t threads) {
+    size_t blocks = bd.size() / 16;
+    const u8* data = bd.bytes(0);
+    if (!data || blocks == 0) return {};
+
+    std::vector<u8> cls(blocks);
+    {
+        WorkerPool pool(threads);
+        for (size_t from = 0; from < blocks; from += CHUNK_BLOCKS) {
+            pool.submit([&, from] {
+                size_t to = std::min(blocks, from + CHUNK_BLOCKS);
+                for (size_t b = from; b < to; ++b) cls[b] = classify(data + b * 16);
+            });
+        }
+        pool.wait_idle();
+    }
+
+    std::vector<CarvedSample> out;
+    // An all-zero block at offset 0 is the usual silent block, not the first sample's
+    static const u8 zeros[16] = {};
+    size_t start = blocks && std::memcmp(data, zeros, 16) == 0 ? 1 : 0;
+    bool signal = false, loopStart = false, repeat = false;
+    for (size_t b = start; b < blocks; ++b) {
+        u8 c = cls[b];
+        if (!(c & BLK_VALID)) {
+            start = b + 1;
+            signal = loopStart = repeat = false;
+            continue;
+        }
+        // Padding in front of a sample: keep one silent block like a VAG has, not all of them
+        if (!signal && !loopStart && !repeat && !(c & (BLK_SIGNAL | BLK_LOOP_START | BLK_REPEAT | BLK_END)))
+            start = b;
+        signal |= (c & BLK_SIGNAL) != 0;
+        loopStart |= (c & BLK_LOOP_START) != 0;
+        repeat |= (c & BLK_REPEAT) != 0;
+        if (!(c & BLK_END)) continue;
+
+        size_t len = b + 1 - start;
+        bool loopOk = !(c & BLK_REPEAT) || loopStart;
+        if (len >= MIN_BLOCKS && signal && loopOk && len * 16 <= MAX_BYTES)
+            out.push_back({ (u32)(start * 16), (u32)(len * 16), repeat });
+        start = b + 1;
+        signal = loopStart = repeat = false;
+    }
+
+    LogInfo("BD carve: " + std::to_string(out.size()) + " samples in " + std::to_string(blocks) + " blocks");
+    return out;
+}
+
+Bank BdCarver::make_bank(const std::vector<CarvedSample>& samples, u32 sample_rate, const std::string& name) {
+    // Instant attack, held full sustain, about half a second of release
+    u32 reg = HardwareADSR::nearest_register(-12000, -12000, 0, -1200);
+
+    Bank bank;
+    std::shared_ptr<Program> prog;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        u8 key = (u8)(i % 128);
+        if (key == 0) {
+            if (prog) bank.programs.push_back(prog);
+            prog = std::make_shared<Program>();
+            prog->id = (u32)(i / 128);
+            prog->name = name + " " + std::to_string(prog->id);
+            prog->master_vol = 127;
+            prog->master_pan = 0x40;
+            prog->is_layered = false;
+        }
+
+        Tone t = {};
+        t.min_note = t.max_note = t.root_key = key;
+        t.pan = 0x40;
+        t.volume = 127;
+        t.adsr1 = (u16)reg;
+        t.adsr2 = (u16)(reg >> 16);
+        t.bd_offset = samples[i].offset;
+        t.sample_rate = samples[i].sample_rate ? samples[i].sample_rate : sample_rate;
+        t.src_split = Tone::NO_SOURCE;
+        prog->tones.push_back(t);
+    }
+    if (prog) bank.programs.push_back(prog);
+    bank.valid = !samples.empty();
+    return bank;
+}
@@ -0,0 +1,29 @@
+#ifndef BDCARVER_H
+#define BDCARVER_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include <vector>
+
+struct CarvedSample {
+    u32 offset;
+    u32 size;    // ADPCM bytes, the same run scan_sample finds from offset
+    bool looping;
+    u32 sample_rate = 0; // 0: the rate given to make_bank
+};
+
+// Finds samples in a BD without its HD. Every 16-byte block is classified (filter <= 4,
+// shift <= 12, flags in the low three bits) in parallel chunks, then one pass over the
+// classes cuts runs at end blocks. A run counts as a sample when all of its blocks are
+// valid, it holds some signal, and a repeat-flagged end has a loop start before it.
+class BdCarver {
+public:
+    static std::vector<CarvedSample> scan(const BDParser& bd, size_t threads = 0);
+
+    // Something to preview and export them with: 128 samples per program, sample i of a
+    // program alone on key i at its natural pitch
+    static Bank make_bank(const std::vector<CarvedSample>& samples, u32 sample_rate, const std::string& name = "Carved");
+};
+
+#endif // BDCARVER_H
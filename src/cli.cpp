@@ -0,0 +1,414 @@
+#include "cli.h"
+#include "main.h"
+#include "reverb.h"
+#include "vagencoder.h"
+#include "bd.h"
+#include "sf2import.h"
+#include "wavextract.h"
+#include "bdcarver.h"
+#include "imagescan.h"
+#include "mappedfile.h"
+#include "vag.h"
+#include "hd.h"
+#include "hdwriter.h"
+#include "bankhistory.h"
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Whole-string unsigned decimal (or 0x hex), false on anything else instead of throwing
+static bool parseU32(const char* s, u32& out) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long v = std::strtoull(s, &end, 0);
+    if (!*s || *s == '-' || *end || errno || v > 0xFFFFFFFFull) return false;
+    out = (u32)v;
+    return true;
+}
+
+// --bench-reverb [rate] [block], per-preset processing cost against the block's real-time budget
+static int benchReverb(int argc, char* argv[]) {
+    u32 rate = 44100, block = 512;
+    if ((argc > 2 && (!parseU32(argv[2], rate) || rate == 0))
+        || (argc > 3 && (!parseU32(argv[3], block) || block == 0 || block > 1 << 20))) {
+        std::cerr << "usage: --bench-reverb [rate] [block]" << std::endl;
+        return 1;
+    }
+
+    const int blocks = 2000;
+    double budgetUs = block * 1e6 / rate;
+
+    // Something with content in every band so the comb/all-pass taps do real work
+    std::vector<s16> src(block);
+    u32 seed = 0x1234567;
+    for (auto& s : src) {
+        seed = seed * 1664525 + 1013904223;
+        s = (s16)(seed >> 16);
+    }
+
+    std::cout << "Reverb block cost: " << block << " frames @ " << rate << " Hz, budget "
+              << std::fixed << std::setprecision(1) << budgetUs << " us" << std::endl;
+
+    std::vector<s16> buf(block);
+    for (int p = SpuReverb::Room; p < SpuReverb::PresetCount; ++p) {
+        SpuReverb rev;
+        rev.configure(p, rate);
+
+        double worst = 0, total = 0;
+        for (int b = 0; b < blocks; ++b) {
+            std::memcpy(buf.data(), src.data(), block * sizeof(s16));
+            auto t0 = std::chrono::steady_clock::now();
+            rev.process(buf.data(), block);
+            auto t1 = std::chrono::steady_clock::now();
+            double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+            total += us;
+            if (us > worst) worst = us;
+        }
+
+        double avg = total / blocks;
+        std::cout << "  " << std::left << std::setw(14) << SpuReverb::preset_name(p) << std::right
+                  << " avg " << std::setw(7) << avg << " us"
+                  << "  worst " << std::setw(7) << worst << " us"
+                  << "  (" << std::setprecision(2) << (avg * 100.0 / budgetUs) << "% of budget)"
+                  << std::setprecision(1) << std::endl;
+    }
+    return 0;
+}
+
+// --bench-vag [count] [seconds], encoder throughput and round-trip SNR on synthetic samples
+static int benchVag(int argc, char* argv[]) {
+    static const double PI = 3.14159265358979323846;
+
+    u32 count = 64;
+    double seconds = 1.0;
+    char* end = nullptr;
+    if ((argc > 2 && (!parseU32(argv[2], count) || count == 0))
+        || (argc > 3 && (seconds = std::strtod(argv[3], &end), *end || !(seconds > 0 && seconds <= 600)))) {
+        std::cerr << "usage: --bench-vag [count] [seconds]" << std::endl;
+        return 1;
+    }
+
+    // Tones plus noise, half of them looping, lengths spread so the pool has uneven work
+    std::vector<DecodedSample> samples(count);
+    u32 seed = 0x1234567;
+    u64 total = 0;
+    for (size_t n = 0; n < count; ++n) {
+        size_t len = (size_t)(44100 * seconds * (0.5 + (n % 4) * 0.25));
+        auto pcm = std::make_shared<std::vector<s16>>(len);
+        double f1 = 110.0 * (1 + n % 7), f2 = f1 * 2.71;
+        for (size_t i = 0; i < len; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            double t = i / 44100.0;
+            double v = 9000 * std::sin(2 * PI * f1 * t) + 4000 * std::sin(2 * PI * f2 * t) * std::exp(-3 * t)
+                     + (double)(s16)(seed >> 16) / 32;
+            (*pcm)[i] = (s16)v;
+        }
+        samples[n].pcm = pcm;
+        samples[n].looping = n % 2;
+        samples[n].loop_start = (u32)(len / 3);
+        samples[n].loop_end = (u32)len;
+        total += len;
+    }
+
+    std::cout << "VAG encode: " << count << " samples, " << total << " frames" << std::endl;
+
+    const struct { VagEncoder::Mode mode; const char* name; } modes[] = {
+        { VagEncoder::Fast, "fast" },
+        { VagEncoder::Quality, "quality" },
+    };
+    for (const auto& m : modes) {
+        for (size_t threads : { (size_t)1, (size_t)0 }) {
+            auto t0 = std::chrono::steady_clock::now();
+            auto out = VagEncoder::encode_all(samples, m.mode, threads);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+            // Round trip through the decoder, non-looping ones line up sample for sample
+            double sig = 0, err = 0;
+            for (size_t n = 0; n < count; ++n) {
+                if (samples[n].looping) continue;
+                DecodedSample d = BDParser::decode_adpcm(out[n], 44100);
+                const std::vector<s16>& a = *samples[n].pcm;
+                for (size_t i = 0; i < a.size(); ++i) {
+                    double e = (double)a[i] - (*d.pcm)[i];
+                    sig += (double)a[i] * a[i];
+                    err += e * e;
+                }
+            }
+
+            std::cout << "  " << std::left << std::setw(8) << m.name << std::right
+                      << (threads == 1 ? " 1 thread  " : " all cores ")
+                      << std::fixed << std::setprecision(0) << std::setw(12) << total / secs << " samples/s"
+                      << std::setprecision(2) << "  SNR " << 10 * std::log10(sig / (err + 1e-9)) << " dB" << std::endl;
+        }
+    }
+    return 0;
+}
+
+// --import-sf2 <in.sf2> <out.hd> [--fast] [--bank N], the BD goes next to the HD
+static int importSf2(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: --import-sf2 <in.sf2> <out.hd> [--fast] [--bank N]" << std::endl;
+        return 1;
+    }
+    QString sf2Path = QString::fromLocal8Bit(argv[2]);
+    QString hdPath = QString::fromLocal8Bit(argv[3]);
+    VagEncoder::Mode mode = VagEncoder::Quality;
+    int bank = -1;
+    for (int i = 4; i < argc; ++i) {
+        std::string arg = argv[i];
+        u32 v = 0;
+        if (arg == "--fast") mode = VagEncoder::Fast;
+        else if (arg == "--bank" && i + 1 < argc && parseU32(argv[++i], v) && v <= 0xFFFF) bank = (int)v;
+        else {
+            std::cerr << "usage: --import-sf2 <in.sf2> <out.hd> [--fast] [--bank N]" << std::endl;
+            return 1;
+        }
+    }
+
+    QString bdPath = hdPath;
+    if (bdPath.endsWith(".hd", Qt::CaseInsensitive)) bdPath.replace(bdPath.length() - 3, 3, ".bd");
+    else bdPath += ".bd";
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (!Sf2Importer::import(sf2Path, hdPath, bdPath, mode, bank)) return 1;
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Imported into " << hdPath.toStdString() << " / " << bdPath.toStdString()
+              << " in " << std::fixed << std::setprecision(2) << secs << " s" << std::endl;
+    return 0;
+}
+
+// --extract-wav <in.hd> <out_dir> [--threads N], every distinct sample of the bank as WAV
+static int extractWav(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: --extract-wav <in.hd> <out_dir> [--threads N]" << std::endl;
+        return 1;
+    }
+    QString hdPath = QString::fromLocal8Bit(argv[2]);
+    QString dir = QString::fromLocal8Bit(argv[3]);
+    size_t threads = 0;
+    for (int i = 4; i < argc; ++i) {
+        u32 v = 0;
+        if (std::string(argv[i]) == "--threads" && i + 1 < argc && parseU32(argv[++i], v) && v <= 1024) threads = v;
+        else {
+            std::cerr << "usage: --extract-wav <in.hd> <out_dir> [--threads N]" << std::endl;
+            return 1;
+        }
+    }
+
+    QString bdPath = hdPath;
+    if (bdPath.endsWith(".hd", Qt::CaseInsensitive)) bdPath.replace(bdPath.length() - 3, 3, ".bd");
+    else bdPath += ".bd";
+
+    Bank bank;
+    BDParser bd;
+    HDParser hd;
+    if (!hd.load(hdPath, bank) || !bd.load(bdPath)) return 1;
+
+    auto t0 = std::chrono::steady_clock::now();
+    ExportStats stats;
+    if (!WavExtractor::extract(dir, { { &bank, &bd, 0 } }, &stats, threads)) return 1;
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Extracted " << stats.samples << " samples (" << stats.duplicates << " duplicates skipped) in "
+              << std::fixed << std::setprecision(2) << secs << " s" << std::endl;
+    return 0;
+}
+
+// --carve-bd <in.bd> <out_dir> [--rate N], samples found without the HD, written as WAV
+static int carveBd(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: --carve-bd <in.bd> <out_dir> [--rate N]" << std::endl;
+        return 1;
+    }
+    u32 rate = 22050;
+    for (int i = 4; i < argc; ++i) {
+        u32 v = 0;
+        if (std::string(argv[i]) == "--rate" && i + 1 < argc && parseU32(argv[++i], v) && v > 0) rate = v;
+        else {
+            std::cerr << "usage: --carve-bd <in.bd> <out_dir> [--rate N]" << std::endl;
+            return 1;
+        }
+    }
+
+    BDParser bd;
+    if (!bd.load(QString::fromLocal8Bit(argv[2]))) return 1;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<CarvedSample> found = BdCarver::scan(bd);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Found " << found.size() << " samples in " << std::fixed << std::setprecision(3) << secs << " s ("
+              << std::setprecision(0) << bd.size() / secs / 1e6 << " MB/s)" << std::endl;
+    if (found.empty()) return 1;
+
+    Bank bank = BdCarver::make_bank(found, rate);
+    return WavExtractor::extract(QString::fromLocal8Bit(argv[3]), { { &bank, &bd, 0 } }) ? 0 : 1;
+}
+
+// --scan-image <image> [--out <dir>] [--threads N], lists the banks inside a disc image or
+// archive, and with --out writes their samples as WAV
+static int scanImage(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: --scan-image <image> [--out <dir>] [--threads N]" << std::endl;
+        return 1;
+    }
+    QString outDir;
+    size_t threads = 0;
+    for (int i = 3; i < argc; ++i) {
+        std::string a = argv[i];
+        u32 v = 0;
+        if (a == "--out" && i + 1 < argc) outDir = QString::fromLocal8Bit(argv[++i]);
+        else if (a == "--threads" && i + 1 < argc && parseU32(argv[++i], v) && v <= 1024) threads = v;
+        else {
+            std::cerr << "usage: --scan-image <image> [--out <dir>] [--threads N]" << std::endl;
+            return 1;
+        }
+    }
+
+    MappedFile image;
+    if (!image.open(QString::fromLocal8Bit(argv[2]))) return 1;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<ImageBank> found = ImageScanner::scan(image.data(), image.size(), threads);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::vector<BDParser> bds(found.size());
+    std::vector<ExportBank> banks;
+    for (size_t i = 0; i < found.size(); ++i) {
+        const ImageBank& ib = found[i];
+        std::cout << "HD @ 0x" << std::hex << std::setw(8) << std::setfill('0') << ib.hd_offset << std::dec << std::setfill(' ')
+                  << " (" << ib.hd_size << " bytes, " << ib.bank.programs.size() << " programs)";
+        if (!ib.bd_size) {
+            std::cout << ", no BD" << std::endl;
+            continue;
+        }
+        std::cout << ", BD @ 0x" << std::hex << std::setw(8) << std::setfill('0') << ib.bd_offset << std::dec << std::setfill(' ')
+                  << " (" << ib.bd_size << " bytes)" << std::endl;
+        bds[i].view(nullptr, image.data() + ib.bd_offset, ib.bd_size);
+        banks.push_back({ &ib.bank, &bds[i], (u16)banks.size() });
+    }
+    std::cout << found.size() << " HDs, " << banks.size() << " with a BD, in " << std::fixed << std::setprecision(3) << secs << " s ("
+              << std::setprecision(0) << image.size() / secs / 1e6 << " MB/s)" << std::endl;
+
+    if (outDir.isEmpty() || banks.empty()) return banks.empty() ? 1 : 0;
+    return WavExtractor::extract(outDir, banks, nullptr, threads) ? 0 : 1;
+}
+
+// --decode-vag <out_dir> <in.vag | dir>... [--threads N], standalone VAGs to WAV
+static int decodeVag(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: --decode-vag <out_dir> <in.vag | dir>... [--threads N]" << std::endl;
+        return 1;
+    }
+    std::vector<QString> inputs;
+    size_t threads = 0;
+    for (int i = 3; i < argc; ++i) {
+        u32 v = 0;
+        if (std::string(argv[i]) != "--threads") inputs.push_back(QString::fromLocal8Bit(argv[i]));
+        else if (i + 1 < argc && parseU32(argv[++i], v) && v <= 1024) threads = v;
+        else {
+            std::cerr << "usage: --decode-vag <out_dir> <in.vag | dir>... [--threads N]" << std::endl;
+            return 1;
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    VagBatchStats stats;
+    bool ok = VagReader::decode_all(inputs, QString::fromLocal8Bit(argv[2]), &stats, threads);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Decoded " << stats.decoded << " VAG files (" << stats.skipped << " skipped, " << stats.wav_bytes / 1024
+              << " KB written) in " << std::fixed << std::setprecision(2) << secs << " s" << std::endl;
+    return ok ? 0 : 1;
+}
+
+static bool sameTone(const Tone& a, const Tone& b) {
+    return a.min_note == b.min_note && a.max_note == b.max_note && a.root_key == b.root_key && a.pitch_fine == b.pitch_fine
+        && a.pan == b.pan && a.volume == b.volume && a.adsr1 == b.adsr1 && a.adsr2 == b.adsr2 && a.bd_offset == b.bd_offset
+        && a.sample_rate == b.sample_rate;
+}
+
+// --check-hd-roundtrip <in.hd> <out.hd>, edits every tone and program, writes the bank
+// and reads it back; fails unless the reloaded values are the edited ones
+static int checkHdRoundtrip(int argc, char* argv[]) {
+    if (argc < 4) {
+        std::cerr << "usage: --check-hd-roundtrip <in.hd> <out.hd>" << std::endl;
+        return 1;
+    }
+    auto bdOf = [](QString path) {
+        if (path.endsWith(".hd", Qt::CaseInsensitive)) return path.replace(path.length() - 3, 3, ".bd");
+        return path + ".bd";
+    };
+    QString inHd = QString::fromLocal8Bit(argv[2]), outHd = QString::fromLocal8Bit(argv[3]);
+
+    Bank bank;
+    BDParser bd;
+    HDParser hd;
+    if (!hd.load(inHd, bank) || !bd.load(bdOf(inHd))) return 1;
+
+    // A different value in every editable field. Master pan stays, it moves the tones.
+    size_t edits = 0;
+    for (size_t p = 0; p < bank.programs.size(); ++p) {
+        auto prog = bank.programs[p];
+        Bank next;
+        if (p % 2 && BankHistory::with_program(bank, prog->id, (u8)(127 - prog->master_vol % 128), prog->master_pan, next)) {
+            bank = next;
+            ++edits;
+        }
+        for (size_t i = 0; i < prog->tones.size(); ++i) {
+            Tone t = bank.programs[p]->tones[i];
+            t.root_key = (u8)((t.root_key + 1) % 128);
+            t.pitch_fine = (s8)(t.pitch_fine + 3);
+            t.pan = (u8)(t.pan > 0x40 ? t.pan - 7 : t.pan + 7);
+            t.volume = (u8)(127 - t.volume % 128);
+            t.adsr1 ^= 0x0101;
+            t.adsr2 ^= 0x0202;
+            if (i == 0 && t.max_note > t.min_note) t.max_note--;
+            if (BankHistory::with_tone(bank, prog->id, i, t, next)) {
+                bank = next;
+                ++edits;
+            }
+        }
+    }
+
+    if (!HDWriter::write(outHd, bdOf(outHd), bank, bd)) return 1;
+    Bank back;
+    if (!hd.load(outHd, back)) return 1;
+
+    size_t tones = 0, wrong = 0;
+    if (back.programs.size() != bank.programs.size()) {
+        std::cout << "Program count " << bank.programs.size() << " written, " << back.programs.size() << " read back" << std::endl;
+        return 1;
+    }
+    for (size_t p = 0; p < bank.programs.size(); ++p) {
+        const Program& a = *bank.programs[p];
+        const Program& b = *back.programs[p];
+        if (a.id != b.id || a.master_vol != b.master_vol || a.master_pan != b.master_pan || a.tones.size() != b.tones.size()) {
+            std::cout << "Program " << a.id << " differs" << std::endl;
+            ++wrong;
+            continue;
+        }
+        for (size_t i = 0; i < a.tones.size(); ++i, ++tones) {
+            if (sameTone(a.tones[i], b.tones[i])) continue;
+            std::cout << "Program " << a.id << " tone " << i << " differs" << std::endl;
+            ++wrong;
+        }
+    }
+    std::cout << edits << " edits, " << tones << " tones read back, " << wrong << " wrong" << std::endl;
+    return wrong ? 1 : 0;
+}
+
+int Cli::run(int argc, char* argv[]) {
+    if (argc < 2) return -1;
+    std::string cmd = argv[1];
+
+    if (cmd == "--bench-reverb") return benchReverb(argc, argv);
+    if (cmd == "--bench-vag") return benchVag(argc, argv);
+    if (cmd == "--import-sf2") return importSf2(argc, argv);
+    if (cmd == "--extract-wav") return extractWav(argc, argv);
+    if (cmd == "--carve-bd") return carveBd(argc, argv);
+    if (cmd == "--scan-image") return scanImage(argc, argv);
+    if (cmd == "--decode-vag") return decodeVag(argc, argv);
+    if (cmd == "--check-hd-roundtrip") return checkHdRoundtrip(argc, argv);
+
+    return -1;
+}
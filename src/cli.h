@@ -0,0 +1,11 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Headless entry points (benchmarks, batch jobs). No QApplication needed.
+class Cli {
+public:
+    // Returns the exit code, or -1 when argv has no headless command and the GUI should start
+    static int run(int argc, char* argv[]);
+};
+
+#endif // CLI_H
@@ -0,0 +1,81 @@
+#ifndef COW_H
+#define COW_H
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+// Vector whose elements are shared between copies until one of them writes. Elements
+// live in fixed-size chunks behind a chunk list, both refcounted: copying is one bump,
+// and a write duplicates the chunk list plus the one chunk it lands in, so a value
+// holding these (Bank, Program) can be snapshotted whole at the cost of an edit's chunk.
+// Writers must be on one thread; readers of other copies are never disturbed.
+template <typename T>
+class CowVector {
+    static const size_t CHUNK = 32;
+    using Chunk = std::vector<T>;
+    using Chunks = std::vector<std::shared_ptr<Chunk>>;
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator(const CowVector* v, size_t i) : v(v), i(i) {}
+        const T& operator*() const { return (*v)[i]; }
+        const T* operator->() const { return &(*v)[i]; }
+        const_iterator& operator++() { ++i; return *this; }
+        bool operator==(const const_iterator& o) const { return i == o.i; }
+        bool operator!=(const const_iterator& o) const { return i != o.i; }
+
+    private:
+        const CowVector* v;
+        size_t i;
+    };
+
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const T& operator[](size_t i) const { return (*(*d)[i / CHUNK])[i % CHUNK]; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, n); }
+
+    // Writable element, its chunk copied first if another version still refers to it
+    T& edit(size_t i) { return own(i / CHUNK)[i % CHUNK]; }
+    void push_back(const T& v) {
+        if (n % CHUNK == 0) {
+            own_list();
+            d->push_back(std::make_shared<Chunk>());
+            d->back()->reserve(CHUNK);
+        }
+        own(n / CHUNK).push_back(v);
+        ++n;
+    }
+    void clear() {
+        d.reset();
+        n = 0;
+    }
+
+    // Same storage, i.e. nothing was written since one was copied from the other
+    bool shares(const CowVector& o) const { return d == o.d; }
+
+private:
+    void own_list() {
+        if (!d) d = std::make_shared<Chunks>();
+        else if (d.use_count() > 1) d = std::make_shared<Chunks>(*d);
+    }
+    Chunk& own(size_t c) {
+        own_list();
+        std::shared_ptr<Chunk>& chunk = (*d)[c];
+        if (chunk.use_count() > 1) chunk = std::make_shared<Chunk>(*chunk);
+        return *chunk;
+    }
+
+    std::shared_ptr<Chunks> d;
+    size_t n = 0;
+};
+
+#endif // COW_H
@@ -0,0 +1,118 @@
+#include "decodequeue.h"
+#include <algorithm>
+
+// Small enough that the first chunk is ready in well under a millisecond
+static const size_t DECODE_CHUNK_BLOCKS = 64;
+
+// Leave a core for the GUI and the audio callback
+static size_t default_threads() {
+    size_t n = std::thread::hardware_concurrency();
+    return n > 2 ? n - 1 : 1;
+}
+
+DecodeQueue::DecodeQueue(size_t threads) : pool(threads ? threads : default_threads()) {}
+
+DecodeQueue::~DecodeQueue() {
+    clear();
+}
+
+std::shared_ptr<const PendingSample> DecodeQueue::request(u64 key, const BDParser& bd, u32 offset,
+                                                          u32 sample_rate, int priority) {
+    DecodedSample cached;
+    if (cache.get(key, cached)) {
+        auto sample = std::make_shared<PendingSample>();
+        sample->info = cached;
+        sample->info.sample_rate = sample_rate;
+        sample->decoded.store(sample->total(), std::memory_order_release);
+        return sample;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = inflight.find(key);
+    if (it != inflight.end()) {
+        // Already queued, possibly at prefetch priority. A second task at the new
+        // priority races the first, whoever starts first does the work.
+        std::shared_ptr<Job> job = it->second;
+        if (priority > job->priority && !job->started.load(std::memory_order_relaxed))
+            pool.submit([this, job] { run(job); }, priority);
+        job->priority = std::max(job->priority, priority);
+        return job->sample;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->key = key;
+    job->priority = priority;
+    // An offset past the BD decodes to nothing
+    const u8* adpcm = bd.bytes(offset);
+    job->decoder = std::make_unique<AdpcmDecoder>(adpcm, adpcm ? bd.block_run(offset) : 0, sample_rate);
+    job->target = std::make_shared<std::vector<s16>>(job->decoder->total_samples());
+    job->sample = std::make_shared<PendingSample>();
+    job->sample->info = job->decoder->info();
+    job->sample->info.pcm = job->target;
+
+    if (job->target->empty()) return job->sample; // nothing to decode
+
+    inflight[key] = job;
+    pool.submit([this, job] { run(job); }, priority);
+    return job->sample;
+}
+
+void DecodeQueue::drop(Job& job) {
+    job.cancelled.store(true, std::memory_order_relaxed);
+    job.sample->cancelled.store(true, std::memory_order_release);
+}
+
+void DecodeQueue::retain(const std::vector<u64>& keep) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = inflight.begin(); it != inflight.end();) {
+        if (it->second->priority > Background && std::find(keep.begin(), keep.end(), it->first) == keep.end()) {
+            drop(*it->second);
+            it = inflight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DecodeQueue::cancel(const std::vector<u64>& keys) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (u64 key : keys) {
+        auto it = inflight.find(key);
+        if (it == inflight.end() || it->second->priority > Background) continue;
+        drop(*it->second);
+        inflight.erase(it);
+    }
+}
+
+void DecodeQueue::clear() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& kv : inflight) drop(*kv.second);
+        inflight.clear();
+        pool.clear();
+    }
+    // Running jobs read straight out of the BD, they have to be gone before it is reloaded
+    pool.wait_idle();
+    cache.clear();
+}
+
+void DecodeQueue::run(const std::shared_ptr<Job>& job) {
+    if (job->cancelled.load(std::memory_order_relaxed)) return;
+    if (job->started.exchange(true)) return;
+
+    size_t done = 0;
+    while (!job->decoder->finished()) {
+        if (job->cancelled.load(std::memory_order_relaxed)) break;
+        done += job->decoder->decode(job->target->data() + done, DECODE_CHUNK_BLOCKS);
+        job->sample->decoded.store(done, std::memory_order_release);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (job->decoder->finished() && !job->cancelled.load(std::memory_order_relaxed))
+        cache.put(job->key, job->sample->info);
+
+    auto it = inflight.find(job->key);
+    if (it != inflight.end() && it->second == job) inflight.erase(it);
+    job->decoder.reset();
+}
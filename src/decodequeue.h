@@ -0,0 +1,68 @@
+#ifndef DECODEQUEUE_H
+#define DECODEQUEUE_H
+
+#include "main.h"
+#include "bd.h"
+#include "samplecache.h"
+#include "workerpool.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// A sample that may still be decoding. info is complete from the start (flag pre-scan),
+// info.pcm[0, decoded) is final and safe to read from any thread.
+struct PendingSample {
+    DecodedSample info;
+    std::atomic<size_t> decoded{0};
+    std::atomic<bool> cancelled{false}; // will never finish, ask again if still wanted
+
+    size_t total() const { return info.pcm ? info.pcm->size() : 0; }
+    bool finished() const { return decoded.load(std::memory_order_acquire) == total(); }
+};
+
+// Decodes tones on a worker pool. The selected tone goes to the front, neighbours are
+// prefetched behind it, and anything the user has moved away from gets cancelled.
+// Finished samples land in the cache so revisiting them is free.
+class DecodeQueue {
+public:
+    // Background jobs (row thumbnails) run behind every prefetch, and retain() leaves them
+    // alone; whoever asked for them cancels them with cancel()
+    enum Priority { Background = -1000, Prefetch = 0, Selected = 100 };
+
+    explicit DecodeQueue(size_t threads = 0);
+    ~DecodeQueue();
+
+    // Cached, in flight, or newly queued. Never blocks on the decode itself.
+    // The BD must stay loaded until clear() has returned.
+    std::shared_ptr<const PendingSample> request(u64 key, const BDParser& bd, u32 offset,
+                                                 u32 sample_rate, int priority);
+    // Cancels in-flight jobs whose key is not in keep, background ones excepted
+    void retain(const std::vector<u64>& keep);
+    // Cancels these if nothing asked for them above Background
+    void cancel(const std::vector<u64>& keys);
+    // Cancels everything, waits for running jobs and drops the cache. Call before reloading the BD.
+    void clear();
+
+private:
+    struct Job {
+        u64 key;
+        std::shared_ptr<PendingSample> sample;
+        std::shared_ptr<std::vector<s16>> target; // same storage as sample->info.pcm
+        std::unique_ptr<AdpcmDecoder> decoder;
+        int priority; // highest it was asked for, under the mutex
+        std::atomic<bool> started{false};
+        std::atomic<bool> cancelled{false};
+    };
+
+    void run(const std::shared_ptr<Job>& job);
+    static void drop(Job& job);
+
+    SampleCache cache;
+    std::mutex mutex;
+    std::unordered_map<u64, std::shared_ptr<Job>> inflight;
+    WorkerPool pool; // last, so workers are joined before the rest goes away
+};
+
+#endif // DECODEQUEUE_H
@@ -0,0 +1,303 @@
+#include "dlswriter.h"
+#include "partfile.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+
+// DLS2 connection destinations we emit, source/control are always none
+enum : u16 {
+    CONN_DST_PAN = 0x0004,
+    CONN_DST_EG1_ATTACKTIME = 0x0206,
+    CONN_DST_EG1_DECAYTIME = 0x0207,
+    CONN_DST_EG1_RELEASETIME = 0x0209,
+    CONN_DST_EG1_SUSTAINLEVEL = 0x020A,
+};
+
+static const u32 F_INSTRUMENT_DRUMS = 0x80000000;
+static const u32 F_WSMP_NO_TRUNCATION = 0x0001;
+static const u16 F_RGN_OPTION_SELFNONEXCLUSIVE = 0x0001;
+static const u32 WAVELINK_CHANNEL_LEFT = 0x0001;
+// Decode granularity, same as the SF2 writer
+static const size_t CHUNK_BLOCKS = 1024;
+
+namespace {
+// Little-endian byte buffer for everything but the wave data. Chunks and lists are
+// opened in place and their sizes patched on close, so nesting never copies.
+struct Buf {
+    std::vector<u8> b;
+    void put8(u8 v) { b.push_back(v); }
+    void put16(u16 v) { put8(v & 0xFF); put8(v >> 8); }
+    void put32(u32 v) { put16(v & 0xFFFF); put16(v >> 16); }
+    void tag(const char* t) { b.insert(b.end(), t, t + 4); }
+    void zstr(const std::string& s) {
+        b.insert(b.end(), s.begin(), s.end());
+        put8(0);
+        if (b.size() & 1) put8(0);
+    }
+    size_t open(const char* t) {
+        tag(t);
+        put32(0);
+        return b.size();
+    }
+    size_t open_list(const char* type) {
+        size_t at = open("LIST");
+        tag(type);
+        return at;
+    }
+    void set_size(size_t at, u32 n) {
+        b[at - 4] = (u8)n;
+        b[at - 3] = (u8)(n >> 8);
+        b[at - 2] = (u8)(n >> 16);
+        b[at - 1] = (u8)(n >> 24);
+    }
+    void close(size_t at) {
+        u32 n = (u32)(b.size() - at);
+        set_size(at, n);
+        if (n & 1) put8(0);
+    }
+};
+
+// Loop in sample frames, end exclusive, clamped like the SF2 sample headers
+struct WaveLoop {
+    bool on = false;
+    u32 start = 0, length = 0;
+};
+}
+
+static WaveLoop wave_loop(const AdpcmDecoder& dec) {
+    const DecodedSample& lay = dec.info();
+    u32 total = (u32)dec.total_samples();
+    WaveLoop l;
+    if (!lay.looping || total == 0) return l;
+    u32 ls = lay.loop_start;
+    u32 le = lay.loop_end > ls ? lay.loop_end : total;
+    if (le > total) le = total;
+    if (ls >= le) return l;
+    l.on = true;
+    l.start = ls;
+    l.length = le - ls;
+    return l;
+}
+
+static void put_wsmp(Buf& out, u8 root_key, s8 fine, const WaveLoop& loop) {
+    size_t at = out.open("wsmp");
+    out.put32(20);
+    out.put16(root_key > 0 ? root_key : 60);
+    out.put16((u16)(s16)fine);
+    out.put32(0); // attenuation
+    out.put32(F_WSMP_NO_TRUNCATION);
+    out.put32(loop.on ? 1 : 0);
+    if (loop.on) {
+        out.put32(16);
+        out.put32(0); // forward
+        out.put32(loop.start);
+        out.put32(loop.length);
+    }
+    out.close(at);
+}
+
+// Timecents go over as absolute time cents in 16.16, the SF2 "instant" marker becomes
+// the DLS one
+static u32 time_scale(s16 tc) {
+    return tc == -32768 ? 0x80000000u : (u32)((s32)tc * 65536);
+}
+
+static void put32(std::ofstream& out, u32 v) {
+    u8 b[4] = { (u8)v, (u8)(v >> 8), (u8)(v >> 16), (u8)(v >> 24) };
+    out.write(reinterpret_cast<const char*>(b), 4);
+}
+
+bool DlsWriter::write(const std::string& path, const ExportPlan& plan, const std::string& bank_name) {
+    const SampleStore& store = plan.samples();
+
+    // Flag pre-scan only, the same decoders stream the data later
+    std::vector<AdpcmDecoder> decoders;
+    std::vector<WaveLoop> loops;
+    decoders.reserve(store.size());
+    loops.reserve(store.size());
+    for (u32 i = 0; i < store.size(); ++i) {
+        const SampleStore::Entry& e = store.entry(i);
+        decoders.emplace_back(e.bd->bytes(e.offset), e.size, e.sample_rate);
+        loops.push_back(wave_loop(decoders.back()));
+    }
+
+    // Instruments, one per program, articulation per region since every zone has its own.
+    // The whole collection header goes into one buffer: colh, lins, ptbl.
+    Buf head;
+    size_t zones = 0;
+    for (const ExportProgram& ep : plan.programs()) zones += ep.zones.size();
+    head.b.reserve(plan.programs().size() * 64 + zones * 192 + store.size() * 4 + 64);
+    size_t colh = head.open("colh");
+    head.put32((u32)plan.programs().size());
+    head.close(colh);
+
+    size_t lins = head.open_list("lins");
+    for (const ExportProgram& ep : plan.programs()) {
+        size_t ins = head.open_list("ins ");
+        size_t insh = head.open("insh");
+        head.put32((u32)ep.zones.size());
+        head.put32(ep.bank == 128 ? F_INSTRUMENT_DRUMS : (u32)(ep.bank & 0x7F) << 8);
+        head.put32(ep.program);
+        head.close(insh);
+
+        size_t lrgn = head.open_list("lrgn");
+        for (const ExportZone& z : ep.zones) {
+            size_t rgn = head.open_list("rgn2");
+
+            size_t rgnh = head.open("rgnh");
+            head.put16(z.key_lo);
+            head.put16(z.key_hi);
+            head.put16(0);
+            head.put16(127);
+            head.put16(F_RGN_OPTION_SELFNONEXCLUSIVE);
+            head.put16(0); // key group
+            head.put16(0); // layer
+            head.close(rgnh);
+
+            // The region's own tuning over the wave's, tones sharing a wave may differ
+            put_wsmp(head, z.tone->root_key, z.tone->pitch_fine, z.looping ? loops[z.sample] : WaveLoop());
+
+            size_t wlnk = head.open("wlnk");
+            head.put16(0);
+            head.put16(0);
+            head.put32(WAVELINK_CHANNEL_LEFT);
+            head.put32(z.sample);
+            head.close(wlnk);
+
+            // Sustain is attenuation in centibels on the plan side, DLS wants 0.1% of peak
+            s32 sustain = (s32)std::lround(1000.0 * std::pow(10.0, -z.sustain_cb / 200.0));
+            const struct { u16 dst; u32 scale; } conns[] = {
+                { CONN_DST_PAN, (u32)((s32)z.pan * 65536) },
+                { CONN_DST_EG1_ATTACKTIME, time_scale(z.attack_tc) },
+                { CONN_DST_EG1_DECAYTIME, time_scale(z.decay_tc) },
+                { CONN_DST_EG1_SUSTAINLEVEL, (u32)(sustain * 65536) },
+                { CONN_DST_EG1_RELEASETIME, time_scale(z.release_tc) },
+            };
+            size_t lar = head.open_list("lar2");
+            size_t art = head.open("art2");
+            head.put32(8);
+            head.put32((u32)(sizeof(conns) / sizeof(conns[0])));
+            for (const auto& c : conns) {
+                head.put16(0);
+                head.put16(0);
+                head.put16(c.dst);
+                head.put16(0);
+                head.put32(c.scale);
+            }
+            head.close(art);
+            head.close(lar);
+            head.close(rgn);
+        }
+        head.close(lrgn);
+
+        size_t info = head.open_list("INFO");
+        size_t inam = head.open("INAM");
+        head.zstr(ep.name.empty() ? "Program " + std::to_string(ep.program) : ep.name);
+        head.close(inam);
+        head.close(info);
+        head.close(ins);
+    }
+    head.close(lins);
+
+    // Pool table, offsets of each wave LIST, all known from the pre-scan
+    size_t ptbl = head.open("ptbl");
+    head.put32(8);
+    head.put32((u32)store.size());
+    u64 poolBytes = 0;
+    std::vector<u32> dataBytes(store.size());
+    for (u32 i = 0; i < store.size(); ++i) {
+        head.put32((u32)poolBytes);
+        dataBytes[i] = (u32)(decoders[i].total_samples() * sizeof(s16));
+        u32 wsmpBytes = 8 + 20 + (loops[i].on ? 16 : 0);
+        poolBytes += 12 + (8 + 16) + wsmpBytes + 8 + dataBytes[i];
+    }
+    head.close(ptbl);
+
+    Buf tail;
+    size_t info = tail.open_list("INFO");
+    size_t inam = tail.open("INAM");
+    tail.zstr(bank_name);
+    tail.close(inam);
+    size_t isft = tail.open("ISFT");
+    tail.zstr("PS2snd");
+    tail.close(isft);
+    tail.close(info);
+
+    u64 riffBytes = 4 + head.b.size() + 12 + poolBytes + tail.b.size();
+    if (riffBytes > 0xFFFFFFFFull) {
+        LogErr("DLS: bank too large for one RIFF file");
+        return false;
+    }
+
+    PartFile part{ path + ".part" };
+    const std::string& target = part.path;
+    std::ofstream out(target, std::ios::binary);
+    if (!out.is_open()) {
+        LogErr("DLS: could not open " + target);
+        return false;
+    }
+
+    out.write("RIFF", 4);
+    put32(out, (u32)riffBytes);
+    out.write("DLS ", 4);
+    out.write(reinterpret_cast<const char*>(head.b.data()), head.b.size());
+
+    out.write("LIST", 4);
+    put32(out, (u32)(4 + poolBytes));
+    out.write("wvpl", 4);
+
+    std::vector<s16> chunk(CHUNK_BLOCKS * 28);
+    Buf hdr;
+    for (u32 i = 0; i < store.size(); ++i) {
+        const SampleStore::Entry& e = store.entry(i);
+        hdr.b.clear();
+        size_t wave = hdr.open_list("wave");
+        size_t fmt = hdr.open("fmt ");
+        hdr.put16(1); // PCM
+        hdr.put16(1);
+        hdr.put32(e.sample_rate);
+        hdr.put32(e.sample_rate * 2);
+        hdr.put16(2);
+        hdr.put16(16);
+        hdr.close(fmt);
+        put_wsmp(hdr, e.root_key, e.pitch_fine, loops[i]);
+        // LIST and data sizes cover PCM that is not in the buffer yet
+        hdr.tag("data");
+        hdr.put32(dataBytes[i]);
+        hdr.set_size(wave, (u32)(hdr.b.size() - wave) + dataBytes[i]);
+        out.write(reinterpret_cast<const char*>(hdr.b.data()), hdr.b.size());
+
+        AdpcmDecoder& dec = decoders[i];
+        while (!dec.finished()) {
+            size_t n = dec.decode(chunk.data(), CHUNK_BLOCKS);
+            out.write(reinterpret_cast<const char*>(chunk.data()), n * sizeof(s16));
+        }
+        if (!out) {
+            LogErr("DLS: write failed in wave pool");
+            return false;
+        }
+    }
+
+    out.write(reinterpret_cast<const char*>(tail.b.data()), tail.b.size());
+    out.close();
+    if (!out) {
+        LogErr("DLS: write failed");
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(target, path, ec);
+    if (ec) {
+        LogErr("DLS: could not replace " + path + " with " + target);
+        return false;
+    }
+    part.done = true;
+    LogInfo("DLS: wrote " + std::to_string(riffBytes + 8) + " bytes, " + std::to_string(store.size()) + " samples");
+    return true;
+}
+
+bool DlsWriter::exportBanks(const QString& path, const std::vector<ExportBank>& banks, ExportStats* stats) {
+    ExportPlan plan;
+    if (!plan.build(banks)) return false;
+    plan.fill_stats(stats);
+    return write(path.toStdString(), plan);
+}
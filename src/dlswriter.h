@@ -0,0 +1,18 @@
+#ifndef DLSWRITER_H
+#define DLSWRITER_H
+
+#include "main.h"
+#include "exportplan.h"
+#include <QString>
+#include <string>
+
+// DLS Level 2 writer over the same ExportPlan as the SF2 path. Loop points come from
+// the decoders' flag pre-scan, so every size and pool offset is known before the first
+// byte and the wave pool is decoded straight to disk in one sequential pass.
+class DlsWriter {
+public:
+    static bool write(const std::string& path, const ExportPlan& plan, const std::string& bank_name = "PS2snd Export");
+    static bool exportBanks(const QString& path, const std::vector<ExportBank>& banks, ExportStats* stats = nullptr);
+};
+
+#endif // DLSWRITER_H
@@ -0,0 +1,100 @@
+#include "exportmanifest.h"
+#include <fstream>
+
+static const char MAGIC[4] = { 'P', 'S', 'M', 'F' };
+static const u32 VERSION = 2;
+
+namespace {
+struct Reader {
+    std::ifstream& in;
+    template <typename T> T get() {
+        T v{};
+        in.read(reinterpret_cast<char*>(&v), sizeof(T));
+        return v;
+    }
+};
+
+struct Writer {
+    std::ofstream& out;
+    template <typename T> void put(const T& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(T)); }
+};
+}
+
+bool ExportManifest::load(const std::string& path) {
+    programs.clear();
+    samples.clear();
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    char magic[4] = {};
+    in.read(magic, 4);
+    Reader r{ in };
+    if (std::string(magic, 4) != std::string(MAGIC, 4) || r.get<u32>() != VERSION) {
+        LogInfo("Manifest: " + path + " is not a manifest this version wrote, ignored");
+        return false;
+    }
+
+    file_size = r.get<u64>();
+    smpl_offset = r.get<u64>();
+    smpl_hash = r.get<u64>();
+    u32 nPrograms = r.get<u32>();
+    for (u32 i = 0; i < nPrograms && in; ++i) {
+        u64 hash = r.get<u64>();
+        u32 nZones = r.get<u32>();
+        // No program has that many zones, the count is garbage
+        if (nZones > 0xFFFF) in.setstate(std::ios::failbit);
+        if (!in) break;
+        std::vector<ZoneEnvelope> zones(nZones);
+        in.read(reinterpret_cast<char*>(zones.data()), nZones * sizeof(ZoneEnvelope));
+        programs[hash] = std::move(zones);
+    }
+    u32 nSamples = r.get<u32>();
+    for (u32 i = 0; i < nSamples && in; ++i) {
+        u64 key = r.get<u64>();
+        samples[key] = r.get<SamplePos>();
+    }
+
+    if (!in) {
+        LogErr("Manifest: " + path + " is truncated or corrupt, ignored");
+        programs.clear();
+        samples.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ExportManifest::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        LogErr("Manifest: could not open " + path);
+        return false;
+    }
+    Writer w{ out };
+    out.write(MAGIC, 4);
+    w.put(VERSION);
+    w.put(file_size);
+    w.put(smpl_offset);
+    w.put(smpl_hash);
+    w.put((u32)programs.size());
+    for (const auto& p : programs) {
+        w.put(p.first);
+        w.put((u32)p.second.size());
+        out.write(reinterpret_cast<const char*>(p.second.data()), p.second.size() * sizeof(ZoneEnvelope));
+    }
+    w.put((u32)samples.size());
+    for (const auto& s : samples) {
+        w.put(s.first);
+        w.put(s.second);
+    }
+    return (bool)out;
+}
+
+const std::vector<ZoneEnvelope>* ExportManifest::program(u64 hash) const {
+    auto it = programs.find(hash);
+    return it != programs.end() ? &it->second : nullptr;
+}
+
+const ExportManifest::SamplePos* ExportManifest::sample(u64 key) const {
+    auto it = samples.find(key);
+    return it != samples.end() ? &it->second : nullptr;
+}
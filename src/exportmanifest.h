@@ -0,0 +1,45 @@
+#ifndef EXPORTMANIFEST_H
+#define EXPORTMANIFEST_H
+
+#include "main.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ZoneEnvelope {
+    s16 attack_tc, decay_tc, release_tc;
+    u16 sustain_cb;
+};
+
+// What an export wrote, kept next to the output (<file>.manifest) so exporting the same
+// banks again only redoes what changed. Programs are keyed by a hash of their tones and
+// the sample content they use, with the envelopes their zones got. Samples are keyed by
+// SampleStore content key, with where their PCM sits in the output.
+class ExportManifest {
+public:
+    struct SamplePos {
+        u32 start;  // frames into the smpl data
+        u32 frames;
+    };
+
+    static std::string path_for(const std::string& output) { return output + ".manifest"; }
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    const std::vector<ZoneEnvelope>* program(u64 hash) const;
+    const SamplePos* sample(u64 key) const;
+    void add_program(u64 hash, std::vector<ZoneEnvelope> zones) { programs[hash] = std::move(zones); }
+    void add_sample(u64 key, SamplePos pos) { samples[key] = pos; }
+
+    // The output as it was written, the PCM is only reused while the file still matches
+    u64 file_size = 0;
+    u64 smpl_offset = 0; // file offset of the smpl data
+    u64 smpl_hash = 0;   // of the smpl data as written
+
+private:
+    std::unordered_map<u64, std::vector<ZoneEnvelope>> programs;
+    std::unordered_map<u64, SamplePos> samples;
+};
+
+#endif // EXPORTMANIFEST_H
@@ -0,0 +1,192 @@
+#include "exportplan.h"
+#include "adsr.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+
+struct Envelope {
+    s16 attack, decay, release;
+    u16 sustain;
+};
+
+// simulate_timecents ticks the hardware envelope for up to 15s per phase, tones
+// share register pairs a lot so each pair is only run once per bank
+static Envelope convert_envelope(u32 reg) {
+    Envelope e;
+    e.attack = HardwareADSR::simulate_timecents(reg, HardwareADSR::Phase::Attack);
+    e.decay = HardwareADSR::simulate_timecents(reg, HardwareADSR::Phase::Decay);
+    e.release = HardwareADSR::simulate_timecents(reg, HardwareADSR::Phase::Release);
+
+    // Sustain level is ADSR1's low nibble, the hardware holds at (level + 1) / 16 of full
+    // scale. SF2 wants attenuation in cB; this takes a flat 66 cB per step below 15 rather
+    // than the log of that fraction, and level 0 as 1440 cB, the format's silent maximum.
+    // HardwareADSR::nearest_register maps back the same way.
+    u32 susVal = get_bits(reg, 0, 4);
+    e.sustain = static_cast<uint16_t>((15 - susVal) * 66);
+    if (susVal == 0) e.sustain = 1440;
+    return e;
+}
+
+static u64 mix(u64 h, u64 v) {
+    h = (h ^ v) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+}
+
+namespace {
+// Per-bank result before merging. Zone::sample indexes refs until then.
+struct BankPlan {
+    std::vector<ExportProgram> progs;
+    std::vector<std::pair<const Tone*, SampleSpan>> refs;
+    size_t reused = 0;
+};
+}
+
+static void plan_bank(const ExportBank& src, const ExportManifest* previous, BankPlan& out) {
+    std::unordered_map<u32, Envelope> envelopes;
+    std::unordered_map<u64, u32> ref_of; // (rate, offset) -> refs index
+
+    for (const auto& prog : src.bank->programs) {
+        if (!prog) continue;
+
+        ExportProgram ep;
+        ep.bank = src.number;
+        ep.program = (u16)prog->id;
+        ep.name = prog->name;
+        ep.hash = 0;
+
+        auto addZone = [&](const Tone& t, int forcedPan) {
+            u64 where = ((u64)t.sample_rate << 32) | t.bd_offset;
+            auto r = ref_of.find(where);
+            if (r == ref_of.end()) {
+                SampleSpan span = src.bd->scan_sample(t.bd_offset);
+                if (span.size == 0) return;
+                r = ref_of.emplace(where, (u32)out.refs.size()).first;
+                out.refs.push_back({ &t, span });
+            }
+
+            const SampleSpan& span = out.refs[r->second].second;
+            ep.hash = mix(ep.hash, span.hash);
+            ep.hash = mix(ep.hash, ((u64)t.adsr2 << 48) | ((u64)t.adsr1 << 32) | t.sample_rate);
+            ep.hash = mix(ep.hash, ((u64)(u16)forcedPan << 48) | ((u64)t.min_note << 40) | ((u64)t.max_note << 32)
+                                   | ((u64)t.root_key << 24) | ((u64)(u8)t.pitch_fine << 16) | ((u64)t.pan << 8) | t.volume);
+
+            ExportZone z;
+            z.sample = r->second;
+            z.tone = &t;
+            z.key_lo = std::min(t.min_note, t.max_note);
+            z.key_hi = std::max(t.min_note, t.max_note);
+            int panVal = forcedPan != -1 ? forcedPan : (int(t.pan) - 64) * 10;
+            z.pan = (s16)std::clamp(panVal, -500, 500);
+            z.looping = span.looping;
+            ep.zones.push_back(z);
+        };
+
+        std::vector<bool> processed(prog->tones.size(), false);
+        for (size_t i = 0; i < prog->tones.size(); ++i) {
+            if (processed[i]) continue;
+            processed[i] = true;
+            const auto& t1 = prog->tones[i];
+
+            // Simple Stereo pairing logic
+            if (prog->is_layered && (i + 1 < prog->tones.size())) {
+                const auto& t2 = prog->tones[i + 1];
+                if (t1.min_note == t2.min_note && t1.max_note == t2.max_note) {
+                    processed[i + 1] = true;
+                    addZone(t1, -500);
+                    addZone(t2, 500);
+                    continue;
+                }
+            }
+            addZone(t1, -1);
+        }
+
+        // Envelopes last, an unchanged program has them in the manifest already
+        const std::vector<ZoneEnvelope>* cached = previous ? previous->program(ep.hash) : nullptr;
+        if (cached && cached->size() == ep.zones.size()) {
+            for (size_t i = 0; i < ep.zones.size(); ++i) {
+                const ZoneEnvelope& ze = (*cached)[i];
+                ExportZone& z = ep.zones[i];
+                z.attack_tc = ze.attack_tc;
+                z.decay_tc = ze.decay_tc;
+                z.release_tc = ze.release_tc;
+                z.sustain_cb = ze.sustain_cb;
+            }
+            out.reused++;
+        } else {
+            for (ExportZone& z : ep.zones) {
+                u32 reg = ((u32)z.tone->adsr2 << 16) | z.tone->adsr1;
+                auto env = envelopes.find(reg);
+                if (env == envelopes.end()) env = envelopes.emplace(reg, convert_envelope(reg)).first;
+                z.attack_tc = env->second.attack;
+                z.decay_tc = env->second.decay;
+                z.release_tc = env->second.release;
+                z.sustain_cb = env->second.sustain;
+            }
+        }
+
+        out.progs.push_back(std::move(ep));
+    }
+}
+
+bool ExportPlan::build(const std::vector<ExportBank>& banks, size_t threads, const ExportManifest* previous) {
+    store.clear();
+    progs.clear();
+    reused = 0;
+
+    std::vector<BankPlan> plans(banks.size());
+    {
+        WorkerPool pool(threads ? threads : std::min<size_t>(banks.size(), std::max(1u, std::thread::hardware_concurrency())));
+        for (size_t b = 0; b < banks.size(); ++b)
+            pool.submit([&, b] { plan_bank(banks[b], previous, plans[b]); });
+        pool.wait_idle();
+    }
+
+    // Merge in the given order, samples shared between banks collapse here
+    std::set<std::pair<u16, u16>> taken;
+    for (size_t b = 0; b < banks.size(); ++b) {
+        BankPlan& bp = plans[b];
+        reused += bp.reused;
+        std::vector<u32> remap(bp.refs.size());
+        for (size_t r = 0; r < bp.refs.size(); ++r)
+            remap[r] = store.add(*banks[b].bd, *bp.refs[r].first, bp.refs[r].second);
+
+        size_t clashes = 0;
+        for (auto& ep : bp.progs) {
+            // First bank to claim a (bank, program) slot keeps it
+            if (!taken.insert({ ep.bank, ep.program }).second) {
+                clashes++;
+                continue;
+            }
+            for (auto& z : ep.zones) z.sample = remap[z.sample];
+            progs.push_back(std::move(ep));
+        }
+        if (clashes)
+            LogErr("Export: " + std::to_string(clashes) + " programs of source bank " + std::to_string(b)
+                   + " collide with earlier ones in output bank " + std::to_string(banks[b].number) + ", skipped");
+    }
+
+    LogInfo("Export plan: " + std::to_string(progs.size()) + " programs, " + std::to_string(store.size())
+            + " samples, " + std::to_string(store.duplicates()) + " duplicates merged"
+            + (previous ? ", " + std::to_string(reused) + " programs unchanged" : ""));
+    return !progs.empty();
+}
+
+DecodedSample ExportPlan::decode(u32 i) const {
+    const SampleStore::Entry& e = store.entry(i);
+    AdpcmDecoder dec(e.bd->bytes(e.offset), e.size, e.sample_rate);
+    auto pcm = std::make_shared<std::vector<s16>>(dec.total_samples());
+    dec.decode(pcm->data(), e.size / 16);
+
+    DecodedSample res = dec.info();
+    res.pcm = pcm;
+    return res;
+}
+
+void ExportPlan::fill_stats(ExportStats* stats) const {
+    if (!stats) return;
+    stats->samples = store.size();
+    stats->duplicates = store.duplicates();
+    stats->bytes_saved = store.saved_bytes();
+    stats->programs_reused = reused;
+}
@@ -0,0 +1,69 @@
+#ifndef EXPORTPLAN_H
+#define EXPORTPLAN_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include "samplestore.h"
+#include "exportmanifest.h"
+#include <string>
+#include <vector>
+
+// One source bank and the bank number it gets in the output
+struct ExportBank {
+    const Bank* bank;
+    const BDParser* bd;
+    u16 number;
+};
+
+struct ExportStats {
+    size_t samples = 0;    // distinct samples written
+    size_t duplicates = 0; // locations folded into one of them by content
+    u64 bytes_saved = 0;   // PCM those would have added
+    size_t programs_reused = 0; // envelopes taken from the previous export's manifest
+    size_t samples_reused = 0;  // PCM copied from the previous output instead of decoded
+};
+
+struct ExportZone {
+    u32 sample;        // SampleStore index
+    const Tone* tone;  // where it came from, for writers that want raw fields
+    u8 key_lo, key_hi;
+    s16 pan;           // -500..500, 0.1% units like SF2
+    bool looping;
+    s16 attack_tc;     // timecents, -32768 = instant
+    s16 decay_tc;
+    s16 release_tc;
+    u16 sustain_cb;    // attenuation in centibels
+};
+
+struct ExportProgram {
+    u16 bank;
+    u16 program;
+    std::string name;
+    std::vector<ExportZone> zones;
+    u64 hash; // tones and the content of their samples, for ExportManifest
+};
+
+// Everything the exporters need in a format-neutral form: the distinct samples across all
+// source banks and per program its zones with the envelope already converted.
+// Banks are planned in parallel, the result is merged in the order they were given so
+// output is the same whatever the thread timing.
+class ExportPlan {
+public:
+    // Programs whose hash is in previous take their envelopes from it
+    bool build(const std::vector<ExportBank>& banks, size_t threads = 0, const ExportManifest* previous = nullptr);
+
+    const SampleStore& samples() const { return store; }
+    const std::vector<ExportProgram>& programs() const { return progs; }
+
+    // Decodes store entry i, safe from any thread
+    DecodedSample decode(u32 i) const;
+    void fill_stats(ExportStats* stats) const;
+
+private:
+    SampleStore store;
+    std::vector<ExportProgram> progs;
+    size_t reused = 0;
+};
+
+#endif // EXPORTPLAN_H
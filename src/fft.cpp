@@ -0,0 +1,114 @@
+#include "fft.h"
+#include "simd.h"
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+RealFft::RealFft(size_t n_) : n(n_), m(n_ / 2) {
+    u32 bits = 0;
+    while ((size_t(1) << bits) < m) bits++;
+
+    rev.resize(m);
+    for (u32 i = 0; i < m; ++i) {
+        u32 r = 0;
+        for (u32 b = 0; b < bits; ++b)
+            if (i & (1u << b)) r |= 1u << (bits - 1 - b);
+        rev[i] = r;
+    }
+
+    tw_re.resize(m / 2);
+    tw_im.resize(m / 2);
+    for (size_t k = 0; k < m / 2; ++k) {
+        tw_re[k] = (float)std::cos(-2.0 * PI * k / m);
+        tw_im[k] = (float)std::sin(-2.0 * PI * k / m);
+    }
+
+    split_re.resize(m + 1);
+    split_im.resize(m + 1);
+    for (size_t k = 0; k <= m; ++k) {
+        split_re[k] = (float)std::cos(-2.0 * PI * k / n);
+        split_im[k] = (float)std::sin(-2.0 * PI * k / n);
+    }
+
+    // Hann
+    win.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        win[i] = (float)(0.5 - 0.5 * std::cos(2.0 * PI * i / n));
+
+    work.resize(n);
+    spec.resize(n + 2);
+    frame.resize(n);
+}
+
+void RealFft::forward(const float* in, float* out) {
+    // Pack even/odd samples as one complex signal, in bit-reversed order
+    float* z = work.data();
+    for (size_t i = 0; i < m; ++i) {
+        z[2 * rev[i]] = in[2 * i];
+        z[2 * rev[i] + 1] = in[2 * i + 1];
+    }
+
+    for (size_t len = 2; len <= m; len <<= 1) {
+        size_t half = len >> 1;
+        size_t step = m / len;
+        for (size_t base = 0; base < m; base += len) {
+            for (size_t j = 0; j < half; ++j) {
+                float wr = tw_re[j * step], wi = tw_im[j * step];
+                float* a = z + 2 * (base + j);
+                float* b = z + 2 * (base + j + half);
+                float tr = b[0] * wr - b[1] * wi;
+                float ti = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - tr; b[1] = a[1] - ti;
+                a[0] += tr;       a[1] += ti;
+            }
+        }
+    }
+
+    // X[k] = (Z[k] + Z*[m-k]) / 2 + W^k (Z[k] - Z*[m-k]) / 2i
+    for (size_t k = 0; k <= m; ++k) {
+        size_t k1 = (k == m) ? 0 : k;
+        size_t k2 = (k == 0) ? 0 : m - k;
+        float zr = z[2 * k1], zi = z[2 * k1 + 1];
+        float cr = z[2 * k2], ci = -z[2 * k2 + 1];
+
+        float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+        // (Z - conj) / 2i = (im, -re) / 2
+        float dr = 0.5f * (zi - ci), di = -0.5f * (zr - cr);
+
+        float wr = split_re[k], wi = split_im[k];
+        out[2 * k] = er + dr * wr - di * wi;
+        out[2 * k + 1] = ei + dr * wi + di * wr;
+    }
+}
+
+void RealFft::apply_window(const s16* src, const float* w, float* dst, size_t count) {
+    size_t i = 0;
+#if PS2SND_SSE2
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        // sign-extend s16 -> s32
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        __m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), scale);
+        __m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), scale);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(flo, _mm_loadu_ps(w + i)));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(fhi, _mm_loadu_ps(w + i + 4)));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = src[i] * (1.0f / 32768.0f) * w[i];
+}
+
+void RealFft::power_db(const s16* src, float* db) {
+    apply_window(src, win.data(), frame.data(), n);
+    forward(frame.data(), spec.data());
+
+    // Hann coherent gain is 0.5, so a full-scale sine peaks at n/4
+    const float norm = 1.0f / ((n / 4.0f) * (n / 4.0f));
+    for (size_t k = 0; k < m; ++k) {
+        float re = spec[2 * k], im = spec[2 * k + 1];
+        float p = (re * re + im * im) * norm;
+        db[k] = 10.0f * std::log10(p + 1e-12f);
+    }
+}
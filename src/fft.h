@@ -0,0 +1,36 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include "main.h"
+#include <vector>
+
+// Radix-2 FFT for real input: an n/2-point complex transform plus the usual split step.
+// Not thread safe, give every worker its own instance.
+class RealFft {
+public:
+    explicit RealFft(size_t n);
+
+    size_t size() const { return n; }
+    size_t bins() const { return n / 2; }
+
+    // in: n samples, out: n/2 + 1 interleaved (re, im) pairs
+    void forward(const float* in, float* out);
+
+    // Windowed power spectrum in dB (full scale = 0) for bins [0, n/2)
+    void power_db(const s16* src, float* db);
+
+    const std::vector<float>& window() const { return win; }
+
+    // dst = src * win, s16 to float with the 1/32768 scale folded in
+    static void apply_window(const s16* src, const float* win, float* dst, size_t count);
+
+private:
+    size_t n, m;
+    std::vector<u32> rev;
+    std::vector<float> tw_re, tw_im;      // m-point twiddles
+    std::vector<float> split_re, split_im; // e^(-2*pi*i*k/n) for the real split
+    std::vector<float> win;
+    std::vector<float> work, spec, frame;
+};
+
+#endif // FFT_H
@@ -10,21 +10,24 @@
 bool HDParser::load(const QString& path, Bank& bank) {
     LogInfo("Loading HD: " + path.toStdString());
 
-    std::ifstream file(path.toStdString(), std::ios::binary);
+    std::ifstream file(path.toStdString(), std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
         LogErr("Could not open file.");
         return false;
     }
 
-    auto readAt = [&](u32 offset, void* dest, size_t size) -> bool {
-        if (offset == null) return false;
-
-        file.clear();
-        file.seekg(offset, std::ios::beg);
-        if (file.fail()) return false;
+    std::vector<u8> data((size_t)file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!file) return false;
+    return parse(data.data(), data.size(), bank);
+}
 
-        file.read(reinterpret_cast<char*>(dest), size);
-        return (file.gcount() == (std::streamsize)size);
+bool HDParser::parse(const u8* data, size_t size, Bank& bank) {
+    auto readAt = [&](u32 offset, void* dest, size_t len) -> bool {
+        if (offset == null || (u64)offset + len > size) return false;
+        std::memcpy(dest, data + offset, len);
+        return true;
     };
 
     auto convertPanValue = [](u8 panVal) -> int {
@@ -60,11 +63,49 @@ bool HDParser::load(const QString& path, Bank& bank) {
         return offsets;
     };
 
+    u32 fileSize = (u32)std::min<size_t>(size, 0xFFFFFFFFu);
+
+    // Raw entry bytes: each runs to the next entry start or the end of its chunk
+    auto loadBlobs = [&](u32 chunkAddr, const std::vector<u32>& offsets) -> std::vector<std::vector<u8>> {
+        std::vector<std::vector<u8>> blobs(offsets.size());
+        u32 chunkSize = 0;
+        if (offsets.empty() || !readAt(chunkAddr + 8, &chunkSize, 4)) return blobs;
+        u32 chunkEnd = std::min<u64>((u64)chunkAddr + chunkSize, fileSize);
+
+        std::vector<u32> starts;
+        for (u32 off : offsets) if (off != null) starts.push_back(off);
+        std::sort(starts.begin(), starts.end());
+        starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+        for (size_t i = 0; i < offsets.size(); ++i) {
+            if (offsets[i] == null || offsets[i] >= chunkEnd) continue;
+            auto next = std::upper_bound(starts.begin(), starts.end(), offsets[i]);
+            u32 end = (next == starts.end() || *next > chunkEnd) ? chunkEnd : *next;
+            blobs[i].resize(end - offsets[i]);
+            if (!readAt(offsets[i], blobs[i].data(), blobs[i].size())) blobs[i].clear();
+        }
+        return blobs;
+    };
+
     auto vagOffsets = loadOffsets(hdr.vagInfoChunkAddr);
     auto sampOffsets = loadOffsets(hdr.sampleChunkAddr);
     auto setOffsets = loadOffsets(hdr.samplesetChunkAddr);
     auto progOffsets = loadOffsets(hdr.programChunkAddr);
 
+    auto tables = std::make_shared<HdTables>();
+    tables->vers = vers;
+    tables->head = hdr;
+    tables->programs = loadBlobs(hdr.programChunkAddr, progOffsets);
+    tables->sample_sets = loadBlobs(hdr.samplesetChunkAddr, setOffsets);
+    tables->samples = loadBlobs(hdr.sampleChunkAddr, sampOffsets);
+    tables->vags = loadBlobs(hdr.vagInfoChunkAddr, vagOffsets);
+    u32 seSize = 0;
+    if (hdr.seTimbreChunkAddr != 0 && hdr.seTimbreChunkAddr != null && readAt(hdr.seTimbreChunkAddr + 8, &seSize, 4)
+        && (u64)hdr.seTimbreChunkAddr + seSize <= fileSize) {
+        tables->se_timbre.resize(seSize);
+        if (!readAt(hdr.seTimbreChunkAddr, tables->se_timbre.data(), seSize)) tables->se_timbre.clear();
+    }
+
     std::vector<VAGInfoParam> vags(vagOffsets.size());
     for(size_t i=0; i<vagOffsets.size(); ++i) readAt(vagOffsets[i], &vags[i], sizeof(VAGInfoParam));
 
@@ -107,7 +148,8 @@ bool HDParser::load(const QString& path, Bank& bank) {
             std::vector<u16> sIndices(nSamples);
             if (!readAt(setAddr + 4, sIndices.data(), nSamples * 2)) continue;
 
-            for (u16 sIdx : sIndices) {
+            for (u8 slot = 0; slot < nSamples; ++slot) {
+                u16 sIdx = sIndices[slot];
                 if (sIdx >= samps.size() || sampOffsets[sIdx] == null) continue;
                 const auto& sp = samps[sIdx];
 
@@ -129,6 +171,9 @@ bool HDParser::load(const QString& path, Bank& bank) {
                 t.bd_offset = vp.vagOffsetAddr;
                 t.sample_rate = vp.vagSampleRate;
                 t.is_reverb_enabled = (sp.sampleGroup & 0x4) || (sp.sampleGroup & 0x8);
+                t.src_split = (u8)s;
+                t.src_slot = slot;
+                t.src_sample = sIdx;
 
                 prog->tones.push_back(t);
             }
@@ -138,6 +183,7 @@ bool HDParser::load(const QString& path, Bank& bank) {
         bank.programs.push_back(prog);
     }
 
+    bank.tables = tables;
     bank.valid = true;
     return true;
 }
@@ -2,38 +2,12 @@
 #define HD_H
 
 #include "main.h"
+#include "cow.h"
 #include <QString>
 #include <vector>
 #include <memory>
 #include <string>
 
-struct Tone {
-    u8 min_note; u8 max_note;
-    u8 root_key; s8 pitch_fine;
-    u8 pan; u8 volume;
-    u16 adsr1; u16 adsr2;
-    u32 bd_offset;
-    u32 sample_rate;
-    bool is_reverb_enabled;
-};
-
-struct Program {
-    u32 id;
-    std::string name;
-    std::vector<Tone> tones;
-    u8 master_vol;
-    u8 master_pan;
-    bool is_layered;
-};
-
-struct Bank {
-    std::vector<std::shared_ptr<Program>> programs;
-    bool valid = false;
-};
-
-
-// ==========================================================
-
 #pragma pack(push, 1)
 
 struct VersCk {
@@ -64,6 +38,11 @@ struct SplitBlock {
     u8 splitVolume; u8 splitPanpot; s8 splitTranspose; s8 splitDetune; // splitPanpot -> u8
 };
 
+struct SampleSetParam {
+    u8 velCurve; u8 velLimitLow; u8 velLimitHigh; u8 nSample;
+    // u16 sampleIndex[nSample] follows
+};
+
 struct SampleParam {
     u16 VagIndex;
     u8 velRangeLow; u8 velCrossFade; u8 velRangeHigh;
@@ -82,9 +61,58 @@ struct VAGInfoParam {
 
 #pragma pack(pop)
 
+// ==========================================================
+
+struct Tone {
+    u8 min_note; u8 max_note;
+    u8 root_key; s8 pitch_fine;
+    u8 pan; u8 volume;
+    u16 adsr1; u16 adsr2;
+    u32 bd_offset;
+    u32 sample_rate;
+    bool is_reverb_enabled;
+    // Where HDParser read it, so HDWriter can put edits back: split block of the program,
+    // slot in that split's sample set, SampleParam index. src_split is NO_SOURCE otherwise.
+    u8 src_split; u8 src_slot; u16 src_sample;
+
+    static const u8 NO_SOURCE = 0xFF;
+};
+
+struct Program {
+    u32 id;
+    std::string name;
+    CowVector<Tone> tones;
+    u8 master_vol;
+    u8 master_pan;
+    bool is_layered;
+};
+
+// The HD's tables as they were read, one blob per entry (empty where the offset table
+// has a hole). Entries run up to the next entry or the chunk end, so fields the parser
+// does not know about come along too and the bank can be written back unchanged.
+struct HdTables {
+    VersCk vers;
+    HdrCk head;
+    std::vector<std::vector<u8>> programs;    // ProgParam + its split blocks
+    std::vector<std::vector<u8>> sample_sets; // SampleSetParam + indices
+    std::vector<std::vector<u8>> samples;     // SampleParam
+    std::vector<std::vector<u8>> vags;        // VAGInfoParam, offsets into the BD
+    std::vector<u8> se_timbre;                // whole chunk, opaque
+};
+
+// A bank is a cheap value: copies share programs and tone arrays until one of them is
+// edited (see BankHistory), the tables are never written through
+struct Bank {
+    CowVector<std::shared_ptr<const Program>> programs;
+    std::shared_ptr<const HdTables> tables;
+    bool valid = false;
+};
+
 class HDParser {
 public:
     bool load(const QString& path, Bank& bank);
+    // Same from an HD already in memory, e.g. a slice of a disc image
+    bool parse(const u8* data, size_t size, Bank& bank);
 };
 
 #endif // HD_H
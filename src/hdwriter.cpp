@@ -0,0 +1,318 @@
+#include "hdwriter.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+#define null 0xFFFFFFFF
+
+// IECS tags as the parser sees them (little-endian reads of the file bytes)
+static const u32 IECS = 0x53434549;
+static const u32 CK_VERS = 0x56657273;
+static const u32 CK_HEAD = 0x48656164;
+static const u32 CK_PROG = 0x50726F67;
+static const u32 CK_SSET = 0x53736574;
+static const u32 CK_SMPL = 0x536D706C;
+static const u32 CK_VAGI = 0x56616769;
+
+// BD writes go through this much buffer before hitting the file
+static const size_t BD_BUFFER = 1 << 20;
+
+static void put32(std::vector<u8>& b, size_t at, u32 v) {
+    std::memcpy(b.data() + at, &v, 4);
+}
+
+static void align(std::vector<u8>& b, size_t to) {
+    while (b.size() % to) b.push_back(0);
+}
+
+// Offset-table chunk: header, maxIndex, (n + 1) offsets relative to the chunk, then the
+// entries 4-byte aligned. Returns the chunk address, null when there is nothing to write.
+static u32 put_table(std::vector<u8>& hd, u32 type, const std::vector<std::vector<u8>>& entries) {
+    if (entries.empty()) return null;
+    align(hd, 16);
+    size_t base = hd.size();
+    hd.resize(base + 16 + entries.size() * 4, 0);
+    put32(hd, base, IECS);
+    put32(hd, base + 4, type);
+    put32(hd, base + 12, (u32)entries.size() - 1);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        u32 rel = null;
+        if (!entries[i].empty()) {
+            align(hd, 4);
+            rel = (u32)(hd.size() - base);
+            hd.insert(hd.end(), entries[i].begin(), entries[i].end());
+        }
+        put32(hd, base + 16 + i * 4, rel);
+    }
+    align(hd, 16);
+    put32(hd, base + 8, (u32)(hd.size() - base));
+    return (u32)base;
+}
+
+// Same as HDParser reads a panpot byte, offset from centre
+static int pan_offset(u8 pan) {
+    if (pan > 0x7F) return (int)0x40 - (int)(pan - 0x7F);
+    return (int)pan - 0x40;
+}
+
+// Program and tone values back into the entries they were parsed from. A field is only
+// rewritten when it no longer matches what the parser would read, so untouched entries
+// keep their bytes. A SampleParam (or sample set) other tones still use as they were is
+// cloned rather than changed under them.
+static bool apply_edits(const Bank& bank, HdTables& t) {
+    struct Use {
+        u32 prog;
+        u8 split, slot;
+        std::vector<u8> entry; // the SampleParam this tone needs
+    };
+    std::map<u16, std::vector<Use>> uses;
+
+    for (const auto& prog : bank.programs) {
+        if (prog->id >= t.programs.size() || t.programs[prog->id].size() < sizeof(ProgParam)) continue;
+        std::vector<u8>& entry = t.programs[prog->id];
+        ProgParam pp, before;
+        std::memcpy(&before, entry.data(), sizeof(ProgParam));
+        pp = before;
+        pp.progVolume = prog->master_vol;
+        pp.progPanpot = prog->master_pan;
+        std::memcpy(entry.data(), &pp, sizeof(ProgParam));
+
+        for (const Tone& tone : prog->tones) {
+            if (tone.src_split == Tone::NO_SOURCE) continue;
+            size_t at = (size_t)pp.splitBlockAddr + tone.src_split * sizeof(SplitBlock);
+            if (at + sizeof(SplitBlock) > entry.size() || tone.src_sample >= t.samples.size()
+                || t.samples[tone.src_sample].size() < sizeof(SampleParam)) {
+                LogErr("HD write: program " + std::to_string(prog->id) + " has a tone outside its tables, edits cannot be stored");
+                return false;
+            }
+            SplitBlock sb;
+            std::memcpy(&sb, entry.data() + at, sizeof(SplitBlock));
+            u8 maxNote = sb.splitRangeHigh < sb.splitRangeLow ? 0x7F : sb.splitRangeHigh;
+            if (tone.min_note != sb.splitRangeLow || tone.max_note != maxNote) {
+                sb.splitRangeLow = tone.min_note;
+                sb.splitRangeHigh = tone.max_note;
+                std::memcpy(entry.data() + at, &sb, sizeof(SplitBlock));
+            }
+
+            Use use{ prog->id, tone.src_split, tone.src_slot, t.samples[tone.src_sample] };
+            SampleParam sp;
+            std::memcpy(&sp, use.entry.data(), sizeof(SampleParam));
+            sp.sampleBaseNote = tone.root_key;
+            if ((s8)(sb.splitDetune + sp.sampleDetune) != tone.pitch_fine) sp.sampleDetune = (s8)(tone.pitch_fine - sb.splitDetune);
+            // Pan is the sum of three, judged against the program pan it was read with so
+            // a master pan edit moves the tones instead of being cancelled out here
+            int parts = pan_offset(sp.samplePanpot) + pan_offset(sb.splitPanpot);
+            if (std::clamp(0x40 + parts + pan_offset(before.progPanpot), 0, 127) != tone.pan) {
+                int own = tone.pan - 0x40 - pan_offset(pp.progPanpot) - pan_offset(sb.splitPanpot);
+                sp.samplePanpot = (u8)std::clamp(0x40 + own, 0, 127);
+            }
+            sp.sampleVolume = tone.volume;
+            sp.sampleAdsr1 = tone.adsr1;
+            sp.sampleAdsr2 = tone.adsr2;
+            std::memcpy(use.entry.data(), &sp, sizeof(SampleParam));
+            uses[tone.src_sample].push_back(std::move(use));
+        }
+    }
+
+    // The first version of a SampleParam keeps its index, any other one gets a new entry
+    // and the splits using it get their own copy of their sample set
+    std::map<std::pair<u32, u8>, u16> ownSet;
+    for (auto& [index, list] : uses) {
+        std::vector<std::pair<const std::vector<u8>*, u16>> versions;
+        for (const Use& use : list) {
+            auto v = std::find_if(versions.begin(), versions.end(), [&](const auto& x) { return *x.first == use.entry; });
+            if (v == versions.end()) {
+                u16 to = index;
+                if (!versions.empty()) {
+                    if (t.samples.size() > 0xFFFF) {
+                        LogErr("HD write: edits need more than 65536 sample entries");
+                        return false;
+                    }
+                    to = (u16)t.samples.size();
+                    t.samples.push_back(use.entry);
+                } else {
+                    t.samples[index] = use.entry;
+                }
+                versions.push_back({ &use.entry, to });
+                v = versions.end() - 1;
+            }
+            if (v->second == index) continue;
+
+            std::vector<u8>& entry = t.programs[use.prog];
+            ProgParam pp;
+            std::memcpy(&pp, entry.data(), sizeof(ProgParam));
+            size_t at = (size_t)pp.splitBlockAddr + use.split * sizeof(SplitBlock);
+            SplitBlock sb;
+            std::memcpy(&sb, entry.data() + at, sizeof(SplitBlock));
+            auto own = ownSet.find({ use.prog, use.split });
+            if (own == ownSet.end()) {
+                if (sb.sampleSetIndex >= t.sample_sets.size() || t.sample_sets.size() > 0xFFFF) {
+                    LogErr("HD write: program " + std::to_string(use.prog) + " cannot get its own sample set");
+                    return false;
+                }
+                own = ownSet.emplace(std::make_pair(use.prog, use.split), (u16)t.sample_sets.size()).first;
+                t.sample_sets.push_back(t.sample_sets[sb.sampleSetIndex]);
+                sb.sampleSetIndex = own->second;
+                std::memcpy(entry.data() + at, &sb, sizeof(SplitBlock));
+            }
+            std::vector<u8>& set = t.sample_sets[own->second];
+            size_t slot = sizeof(SampleSetParam) + use.slot * 2;
+            if (slot + 2 > set.size()) {
+                LogErr("HD write: sample set " + std::to_string(own->second) + " is shorter than its count");
+                return false;
+            }
+            set[slot] = (u8)v->second;
+            set[slot + 1] = (u8)(v->second >> 8);
+        }
+    }
+    return true;
+}
+
+bool HDWriter::write(const QString& hd_path, const QString& bd_path, const Bank& bank, const BDParser& bd) {
+    if (!bank.valid || !bank.tables) {
+        LogErr("HD write: bank has no tables to write");
+        return false;
+    }
+    HdTables t = *bank.tables;
+    if (!apply_edits(bank, t)) return false;
+
+    // BD layout. Vagi entries in source order; a run starting inside the previous run and
+    // sharing its end (a sample that jumps into another's tail) maps into it, the same
+    // bytes anywhere else map to the first copy.
+    struct Run {
+        u32 src, size, dst;
+    };
+    std::vector<Run> runs;
+    std::vector<u32> vagDst(t.vags.size(), 0);
+    std::vector<std::pair<u32, size_t>> order; // source offset, vag index
+    for (size_t i = 0; i < t.vags.size(); ++i) {
+        if (t.vags[i].size() < sizeof(VAGInfoParam)) continue;
+        u32 off;
+        std::memcpy(&off, t.vags[i].data(), 4);
+        order.push_back({ off, i });
+    }
+    std::sort(order.begin(), order.end());
+
+    std::unordered_map<u64, std::vector<size_t>> byHash;
+    // 16 zero bytes first, the usual silent block at BD offset 0
+    u32 cursor = 16;
+    u64 sourceBytes = 0, saved = 0;
+    for (size_t k = 0; k < order.size(); ++k) {
+        u32 off = order[k].first;
+        size_t vag = order[k].second;
+        if (k > 0 && order[k - 1].first == off) {
+            vagDst[vag] = vagDst[order[k - 1].second];
+            continue;
+        }
+
+        SampleSpan span = bd.scan_sample(off);
+        // Nothing written yet. Skipping it would leave the sample on the silent block and
+        // a save that looks fine but mutes it.
+        if (span.size == 0) {
+            LogErr("HD write: Vagi " + std::to_string(vag) + " points past the BD (" + std::to_string(off) + "), nothing written");
+            return false;
+        }
+        sourceBytes += span.size;
+
+        if (!runs.empty()) {
+            const Run& prev = runs.back();
+            if (off > prev.src && off < prev.src + prev.size && off + span.size == prev.src + prev.size) {
+                vagDst[vag] = prev.dst + (off - prev.src);
+                saved += span.size;
+                continue;
+            }
+        }
+
+        bool found = false;
+        for (size_t r : byHash[span.hash]) {
+            if (runs[r].size == span.size && std::memcmp(bd.bytes(runs[r].src), bd.bytes(off), span.size) == 0) {
+                vagDst[vag] = runs[r].dst;
+                saved += span.size;
+                found = true;
+                break;
+            }
+        }
+        if (found) continue;
+
+        byHash[span.hash].push_back(runs.size());
+        runs.push_back({ off, span.size, cursor });
+        vagDst[vag] = cursor;
+        cursor += (span.size + 15) & ~15u;
+    }
+    u32 bdSize = cursor;
+
+    // HD: Vers, Head, then the tables with Vagi offsets pointing into the new BD
+    std::vector<std::vector<u8>> vags = t.vags;
+    for (size_t i = 0; i < vags.size(); ++i) {
+        if (vags[i].size() >= sizeof(VAGInfoParam)) put32(vags[i], 0, vagDst[i]);
+    }
+
+    std::vector<u8> hd(sizeof(VersCk), 0);
+    VersCk vers = t.vers;
+    vers.Creator = IECS;
+    vers.Type = CK_VERS;
+    vers.chunkSize = sizeof(VersCk);
+    std::memcpy(hd.data(), &vers, sizeof(VersCk));
+
+    size_t headAt = hd.size();
+    hd.resize(headAt + sizeof(HdrCk), 0);
+
+    HdrCk head = t.head;
+    head.Creator = IECS;
+    head.Type = CK_HEAD;
+    head.chunkSize = sizeof(HdrCk);
+    head.programChunkAddr = put_table(hd, CK_PROG, t.programs);
+    head.samplesetChunkAddr = put_table(hd, CK_SSET, t.sample_sets);
+    head.sampleChunkAddr = put_table(hd, CK_SMPL, t.samples);
+    head.vagInfoChunkAddr = put_table(hd, CK_VAGI, vags);
+    head.seTimbreChunkAddr = null;
+    if (!t.se_timbre.empty()) {
+        align(hd, 16);
+        head.seTimbreChunkAddr = (u32)hd.size();
+        hd.insert(hd.end(), t.se_timbre.begin(), t.se_timbre.end());
+    }
+    align(hd, 16);
+    head.fileSize = (u32)hd.size();
+    head.bodySize = bdSize;
+    std::memcpy(hd.data() + headAt, &head, sizeof(HdrCk));
+
+    std::ofstream hdOut(hd_path.toStdString(), std::ios::binary);
+    if (!hdOut.is_open()) {
+        LogErr("HD write: could not open " + hd_path.toStdString());
+        return false;
+    }
+    hdOut.write(reinterpret_cast<const char*>(hd.data()), hd.size());
+    if (!hdOut) {
+        LogErr("HD write: write failed");
+        return false;
+    }
+
+    // BD in one sequential pass, runs are already in output order
+    std::vector<char> buffer(BD_BUFFER);
+    std::ofstream bdOut;
+    bdOut.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    bdOut.open(bd_path.toStdString(), std::ios::binary);
+    if (!bdOut.is_open()) {
+        LogErr("BD write: could not open " + bd_path.toStdString());
+        return false;
+    }
+    static const char zeros[16] = {};
+    bdOut.write(zeros, 16);
+    for (const Run& r : runs) {
+        bdOut.write(reinterpret_cast<const char*>(bd.bytes(r.src)), r.size);
+        if (r.size & 15) bdOut.write(zeros, 16 - (r.size & 15));
+    }
+    bdOut.flush();
+    if (!bdOut) {
+        LogErr("BD write: write failed");
+        return false;
+    }
+
+    LogInfo("HD/BD written: " + std::to_string(hd.size()) + " + " + std::to_string(bdSize) + " bytes, "
+            + std::to_string(runs.size()) + " samples, " + std::to_string(saved) + " of " + std::to_string(sourceBytes)
+            + " bytes deduplicated");
+    return true;
+}
@@ -0,0 +1,18 @@
+#ifndef HDWRITER_H
+#define HDWRITER_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include <QString>
+
+// Writes a bank back out as an HD/BD pair from the tables HDParser kept, with the
+// bank's program and tone values put back into their entries. The BD is
+// rebuilt from the runs the Vagi entries point at: each distinct run is stored once,
+// 16-byte aligned, and the Vagi offsets are rewritten to match.
+class HDWriter {
+public:
+    static bool write(const QString& hd_path, const QString& bd_path, const Bank& bank, const BDParser& bd);
+};
+
+#endif // HDWRITER_H
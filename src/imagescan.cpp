@@ -0,0 +1,181 @@
+#include "imagescan.h"
+#include "simd.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#define null 0xFFFFFFFF
+
+// IECS tags as the parser sees them (little-endian reads of the file bytes)
+static const u32 IECS = 0x53434549;
+static const u32 CK_HEAD = 0x48656164;
+static const u32 CK_PROG = 0x50726F67;
+static const u32 CK_SSET = 0x53736574;
+static const u32 CK_SMPL = 0x536D706C;
+static const u32 CK_VAGI = 0x56616769;
+
+// The Vers chunk opening every HD, as bytes
+static const u8 SIGNATURE[8] = { 'I', 'E', 'C', 'S', 's', 'r', 'e', 'V' };
+// Signature search slice per task
+static const size_t SLICE = 64 << 20;
+// A Vers chunk longer than this is not one
+static const u32 MAX_VERS = 256;
+
+static inline u32 rd32(const u8* p) {
+    u32 v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+// Signature starts in [from, to), reading no further than end
+static void find_signatures(const u8* data, size_t from, size_t to, size_t end, std::vector<u64>& out) {
+    size_t i = from;
+#if PS2SND_SSE2
+    // First and fifth byte tested 16 positions at once, the full compare only where both hit
+    const __m128i first = _mm_set1_epi8((char)SIGNATURE[0]);
+    const __m128i fifth = _mm_set1_epi8((char)SIGNATURE[4]);
+    for (; i < to && i + 20 <= end; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(data + i + 4));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, fifth)));
+        for (int bit = 0; mask; ++bit, mask >>= 1) {
+            size_t at = i + bit;
+            if ((mask & 1) && at < to && at + 8 <= end && std::memcmp(data + at, SIGNATURE, 8) == 0) out.push_back(at);
+        }
+    }
+#endif
+    while (i < to) {
+        const u8* p = (const u8*)std::memchr(data + i, SIGNATURE[0], to - i);
+        if (!p) break;
+        size_t at = (size_t)(p - data);
+        if (at + 8 <= end && std::memcmp(p, SIGNATURE, 8) == 0) out.push_back(at);
+        i = at + 1;
+    }
+}
+
+// Size of the HD at data, 0 when its chunks do not hold together
+static u32 hd_size_at(const u8* data, size_t avail) {
+    if (avail < 16) return 0;
+    VersCk vers;
+    std::memcpy(&vers, data, sizeof(VersCk));
+    u32 hdrOffset = (vers.chunkSize < 16) ? 16 : vers.chunkSize;
+    if (hdrOffset > MAX_VERS || hdrOffset + sizeof(HdrCk) > avail) return 0;
+
+    HdrCk hdr;
+    std::memcpy(&hdr, data + hdrOffset, sizeof(HdrCk));
+    if (hdr.Creator != IECS || hdr.Type != CK_HEAD) return 0;
+    if (hdr.fileSize < hdrOffset + sizeof(HdrCk) || hdr.fileSize > avail) return 0;
+
+    auto chunkOk = [&](u32 addr, u32 type, bool required) {
+        if (addr == 0 || addr == null) return !required;
+        if ((u64)addr + 16 > hdr.fileSize) return false;
+        return rd32(data + addr) == IECS && rd32(data + addr + 4) == type;
+    };
+    if (!chunkOk(hdr.programChunkAddr, CK_PROG, false) || !chunkOk(hdr.samplesetChunkAddr, CK_SSET, false)
+        || !chunkOk(hdr.sampleChunkAddr, CK_SMPL, false) || !chunkOk(hdr.vagInfoChunkAddr, CK_VAGI, true))
+        return 0;
+    return hdr.fileSize;
+}
+
+// A BD opens with the silent block. Every offset then lands on a plausible block header
+// that is not padding, and most of them (some point into another sample's tail) right
+// after an end block or that opening silent block.
+static bool bd_fits(const u8* bd, const std::vector<u32>& offsets) {
+    static const u8 zeros[16] = {};
+    if (std::memcmp(bd, zeros, 16) != 0) return false;
+    size_t inner = 0, ends = 0;
+    for (u32 off : offsets) {
+        if (off == 0) continue;
+        const u8* blk = bd + off;
+        if ((blk[0] >> 4) > 4 || (blk[0] & 0x0F) > 12 || blk[1] > 7) return false;
+        if (std::memcmp(blk, zeros, 16) == 0) return false;
+        ++inner;
+        const u8* prev = blk - 16;
+        if ((prev[1] & 1) || prev == bd) ++ends;
+    }
+    return inner && ends * 4 >= inner * 3;
+}
+
+static void match_bd(const u8* data, size_t size, ImageBank& ib) {
+    u32 bdSize = ib.bank.tables->head.bodySize;
+    if (bdSize < 16) return;
+
+    std::vector<u32> offsets;
+    for (const auto& blob : ib.bank.tables->vags) {
+        if (blob.size() < 4) continue;
+        u32 off = rd32(blob.data());
+        if (off % 16 == 0 && off + 16 <= bdSize) offsets.push_back(off);
+    }
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    if (offsets.empty()) return;
+
+    u64 hdEnd = ib.hd_offset + ib.hd_size;
+    auto fits = [&](u64 at) {
+        if (at + bdSize > size) return false;
+        if (at < hdEnd && at + bdSize > ib.hd_offset) return false;
+        return bd_fits(data + at, offsets);
+    };
+    auto found = [&](u64 at) {
+        ib.bd_offset = at;
+        ib.bd_size = bdSize;
+    };
+
+    // Next to the HD, after or before it. Sector alignment first: an HD padded out to the
+    // next sector has zeros after it that a 16-byte slot could start in.
+    for (u64 align : { 2048, 16 }) {
+        u64 after = (hdEnd + align - 1) / align * align;
+        if (fits(after)) return found(after);
+        if (ib.hd_offset >= bdSize) {
+            u64 before = (ib.hd_offset - bdSize) / align * align;
+            if (fits(before)) return found(before);
+        }
+    }
+
+    // Anywhere, sectors first. One sample offset says too little to trust a blind sweep.
+    if (offsets.size() < 3) return;
+    for (u64 align : { 2048, 16 }) {
+        for (u64 at = 0; at + bdSize <= size; at += align) {
+            if (fits(at)) return found(at);
+        }
+    }
+}
+
+std::vector<ImageBank> ImageScanner::scan(const u8* data, size_t size, size_t threads) {
+    WorkerPool pool(threads);
+
+    std::vector<u64> hits;
+    std::mutex mutex;
+    for (size_t from = 0; from < size; from += SLICE) {
+        pool.submit([&, from] {
+            std::vector<u64> found;
+            find_signatures(data, from, std::min(size, from + SLICE), size, found);
+            std::lock_guard<std::mutex> lock(mutex);
+            hits.insert(hits.end(), found.begin(), found.end());
+        });
+    }
+    pool.wait_idle();
+    std::sort(hits.begin(), hits.end());
+
+    std::vector<ImageBank> out;
+    for (u64 at : hits) {
+        u32 hdSize = hd_size_at(data + at, size - at);
+        if (!hdSize) continue;
+        ImageBank ib;
+        ib.hd_offset = at;
+        ib.hd_size = hdSize;
+        HDParser hd;
+        if (!hd.parse(data + at, hdSize, ib.bank) || !ib.bank.tables) continue;
+        out.push_back(std::move(ib));
+    }
+
+    // A sweep for a BD that is not next to its HD reads the whole image, so one per task
+    for (ImageBank& ib : out) pool.submit([&] { match_bd(data, size, ib); });
+    pool.wait_idle();
+
+    size_t matched = std::count_if(out.begin(), out.end(), [](const ImageBank& ib) { return ib.bd_size != 0; });
+    LogInfo("Image scan: " + std::to_string(hits.size()) + " signatures, " + std::to_string(out.size()) + " HDs, "
+            + std::to_string(matched) + " with their BD");
+    return out;
+}
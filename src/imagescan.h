@@ -0,0 +1,27 @@
+#ifndef IMAGESCAN_H
+#define IMAGESCAN_H
+
+#include "main.h"
+#include "hd.h"
+#include <vector>
+
+// An IECS bank found inside a bigger file (ISO, packed archive), offsets into that file
+struct ImageBank {
+    u64 hd_offset = 0;
+    u32 hd_size = 0;
+    u64 bd_offset = 0;
+    u32 bd_size = 0;  // 0 when no region matched the HD's sample offsets
+    Bank bank;        // already parsed from the image
+};
+
+// Finds HDs by their Vers/Head chunk signature, then the BD each one plays from.
+// The signature search runs SIMD over parallel slices of the image; a hit counts once
+// its chunk addresses stay inside the HD and point at the right chunk tags. The BD is
+// the bodySize-long region where every sample offset lands on a valid ADPCM block with
+// an end block right before it, tried next to the HD first and swept for otherwise.
+class ImageScanner {
+public:
+    static std::vector<ImageBank> scan(const u8* data, size_t size, size_t threads = 0);
+};
+
+#endif // IMAGESCAN_H
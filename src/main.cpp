@@ -1,10 +1,14 @@
 #include "ui/ps2snd.h"
+#include "cli.h"
 #include <QApplication>
 
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 
 int main(int argc, char *argv[]) {
+    int rc = Cli::run(argc, argv);
+    if (rc >= 0) return rc;
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -14,6 +14,8 @@ using u16 = uint16_t;
 using s16 = int16_t;
 using u32 = uint32_t;
 using s32 = int32_t;
+using u64 = uint64_t;
+using s64 = int64_t;
 
 inline void LogInfo(const std::string& msg) {
     std::cout << "[INFO] " << msg << std::endl;
@@ -0,0 +1,16 @@
+#include "mappedfile.h"
+
+bool MappedFile::open(const QString& path) {
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        LogErr("Could not open " + path.toStdString());
+        return false;
+    }
+    len = (size_t)file.size();
+    map = len ? file.map(0, file.size()) : nullptr;
+    if (!map) {
+        LogErr("Could not map " + path.toStdString());
+        return false;
+    }
+    return true;
+}
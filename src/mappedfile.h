@@ -0,0 +1,22 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "main.h"
+#include <QFile>
+#include <QString>
+
+// Whole file mapped read-only, so a multi-GB disc image costs nothing until it is read
+// and a small one needs no copy. The view goes away with the object.
+class MappedFile {
+public:
+    bool open(const QString& path);
+    const u8* data() const { return map; }
+    size_t size() const { return len; }
+
+private:
+    QFile file;
+    const u8* map = nullptr;
+    size_t len = 0;
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,18 @@
+#ifndef PARTFILE_H
+#define PARTFILE_H
+
+#include <cstdio>
+#include <string>
+
+// Output written beside its target and renamed over it once complete, so a failed or
+// interrupted export never leaves a truncated file where the old one was. Removes the
+// partial output unless the write got as far as renaming it into place.
+struct PartFile {
+    std::string path;
+    bool done = false;
+    ~PartFile() {
+        if (!done) std::remove(path.c_str());
+    }
+};
+
+#endif // PARTFILE_H
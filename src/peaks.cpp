@@ -0,0 +1,204 @@
+#include "peaks.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+struct Acc {
+    s16 mn = 32767;
+    s16 mx = -32768;
+    double ss = 0;
+};
+
+static void reduce_scalar(const s16* d, size_t n, Acc& a) {
+    for (size_t i = 0; i < n; ++i) {
+        a.mn = std::min(a.mn, d[i]);
+        a.mx = std::max(a.mx, d[i]);
+        a.ss += (double)d[i] * d[i];
+    }
+}
+
+static void reduce(const s16* d, size_t n, Acc& a) {
+#if PS2SND_SSE2
+    size_t i = 0;
+    if (n >= 8) {
+        __m128i vmn = _mm_set1_epi16(32767);
+        __m128i vmx = _mm_set1_epi16(-32768);
+        __m128i vss = _mm_setzero_si128(); // 2 x u64
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(d + i));
+            vmn = _mm_min_epi16(vmn, v);
+            vmx = _mm_max_epi16(vmx, v);
+            // pairwise squares; the only overflow case (two -32768s) is still right read as unsigned
+            __m128i sq = _mm_madd_epi16(v, v);
+            vss = _mm_add_epi64(vss, _mm_unpacklo_epi32(sq, zero));
+            vss = _mm_add_epi64(vss, _mm_unpackhi_epi32(sq, zero));
+        }
+
+        alignas(16) s16 mn[8], mx[8];
+        alignas(16) u64 ss[2];
+        _mm_store_si128((__m128i*)mn, vmn);
+        _mm_store_si128((__m128i*)mx, vmx);
+        _mm_store_si128((__m128i*)ss, vss);
+        for (int k = 0; k < 8; ++k) {
+            a.mn = std::min(a.mn, mn[k]);
+            a.mx = std::max(a.mx, mx[k]);
+        }
+        a.ss += (double)(ss[0] + ss[1]);
+    }
+    reduce_scalar(d + i, n - i, a);
+#else
+    reduce_scalar(d, n, a);
+#endif
+}
+
+// min/max over contiguous bucket arrays
+static void reduce_range(const s16* mn, const s16* mx, const float* ss, size_t n, Acc& a) {
+    size_t i = 0;
+#if PS2SND_SSE2
+    if (n >= 8) {
+        __m128i vmn = _mm_set1_epi16(32767);
+        __m128i vmx = _mm_set1_epi16(-32768);
+        __m128 vss = _mm_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            vmn = _mm_min_epi16(vmn, _mm_loadu_si128((const __m128i*)(mn + i)));
+            vmx = _mm_max_epi16(vmx, _mm_loadu_si128((const __m128i*)(mx + i)));
+            vss = _mm_add_ps(vss, _mm_add_ps(_mm_loadu_ps(ss + i), _mm_loadu_ps(ss + i + 4)));
+        }
+        alignas(16) s16 tmn[8], tmx[8];
+        alignas(16) float tss[4];
+        _mm_store_si128((__m128i*)tmn, vmn);
+        _mm_store_si128((__m128i*)tmx, vmx);
+        _mm_store_ps(tss, vss);
+        for (int k = 0; k < 8; ++k) {
+            a.mn = std::min(a.mn, tmn[k]);
+            a.mx = std::max(a.mx, tmx[k]);
+        }
+        a.ss += (double)tss[0] + tss[1] + tss[2] + tss[3];
+    }
+#endif
+    for (; i < n; ++i) {
+        a.mn = std::min(a.mn, mn[i]);
+        a.mx = std::max(a.mx, mx[i]);
+        a.ss += ss[i];
+    }
+}
+
+void PeakPyramid::clear() {
+    lv.clear();
+    total = 0;
+}
+
+size_t PeakPyramid::bucket_size(size_t level) const {
+    size_t bs = BASE;
+    for (size_t i = 0; i < level; ++i) bs *= FANOUT;
+    return bs;
+}
+
+void PeakPyramid::build(const s16* data, size_t count) {
+    clear();
+    append(data, count);
+}
+
+void PeakPyramid::append(const s16* data, size_t count) {
+    if (count == 0) return;
+    if (lv.empty()) lv.emplace_back();
+
+    Level& l0 = lv[0];
+    size_t first = total / BASE;
+    size_t consumed = 0;
+
+    // Top up a partial tail bucket first, min/max/sumsq all merge
+    size_t partial = total % BASE;
+    if (partial) {
+        size_t n = std::min<size_t>(BASE - partial, count);
+        Acc a;
+        a.mn = l0.min.back(); a.mx = l0.max.back(); a.ss = l0.sumsq.back();
+        reduce_scalar(data, n, a);
+        l0.min.back() = a.mn; l0.max.back() = a.mx; l0.sumsq.back() = (float)a.ss;
+        consumed = n;
+    }
+
+    while (consumed < count) {
+        size_t n = std::min<size_t>(BASE, count - consumed);
+        Acc a;
+        reduce(data + consumed, n, a);
+        l0.min.push_back(a.mn);
+        l0.max.push_back(a.mx);
+        l0.sumsq.push_back((float)a.ss);
+        consumed += n;
+    }
+
+    total += count;
+    rebuild_from(1, first / FANOUT);
+}
+
+void PeakPyramid::rebuild_from(size_t level, size_t first) {
+    for (; ; ++level, first /= FANOUT) {
+        if (lv[level - 1].min.size() <= 1) {
+            lv.resize(level);
+            return;
+        }
+        if (lv.size() <= level) lv.emplace_back();
+        const Level& below = lv[level - 1];
+        Level& cur = lv[level];
+
+        size_t n = (below.min.size() + FANOUT - 1) / FANOUT;
+        cur.min.resize(n);
+        cur.max.resize(n);
+        cur.sumsq.resize(n);
+
+        for (size_t i = first; i < n; ++i) {
+            size_t b = i * FANOUT;
+            size_t e = std::min(b + FANOUT, below.min.size());
+            Acc a;
+            for (size_t k = b; k < e; ++k) {
+                a.mn = std::min(a.mn, below.min[k]);
+                a.mx = std::max(a.mx, below.max[k]);
+                a.ss += below.sumsq[k];
+            }
+            cur.min[i] = a.mn;
+            cur.max[i] = a.mx;
+            cur.sumsq[i] = (float)a.ss;
+        }
+    }
+}
+
+PeakPyramid::Peak PeakPyramid::query(size_t begin, size_t end) const {
+    Peak p;
+    end = std::min(end, total);
+    if (lv.empty() || begin >= end) return p;
+
+    // Coarsest level with at least ~4 buckets across the range keeps edge error small
+    size_t span = end - begin;
+    size_t level = 0, bs = BASE;
+    while (level + 1 < lv.size() && bs * FANOUT * 4 <= span) {
+        bs *= FANOUT;
+        ++level;
+    }
+
+    const Level& l = lv[level];
+    size_t b = begin / bs;
+    size_t e = std::min((end + bs - 1) / bs, l.min.size());
+
+    Acc a;
+    reduce_range(l.min.data() + b, l.max.data() + b, l.sumsq.data() + b, e - b, a);
+
+    size_t covered = std::min(e * bs, total) - b * bs;
+    p.min = a.mn;
+    p.max = a.mx;
+    p.rms = covered ? (float)std::sqrt(a.ss / covered) : 0.0f;
+    return p;
+}
+
+PeakPyramid::Peak PeakPyramid::scan(const s16* data, size_t count) {
+    Peak p;
+    if (!count) return p;
+    Acc a;
+    reduce(data, count, a);
+    p.min = a.mn;
+    p.max = a.mx;
+    p.rms = (float)std::sqrt(a.ss / count);
+    return p;
+}
@@ -0,0 +1,48 @@
+#ifndef PEAKS_H
+#define PEAKS_H
+
+#include "main.h"
+#include <vector>
+
+// Multi-resolution min/max/RMS summary of a PCM run. Level 0 buckets cover BASE samples,
+// every level above merges FANOUT buckets. Built once per sample, extended as data streams in.
+class PeakPyramid {
+public:
+    static const u32 BASE = 16;
+    static const u32 FANOUT = 4;
+
+    struct Peak {
+        s16 min = 0;
+        s16 max = 0;
+        float rms = 0;
+    };
+
+    void clear();
+    void build(const s16* data, size_t count);
+    void append(const s16* data, size_t count);
+
+    size_t samples() const { return total; }
+    size_t levels() const { return lv.size(); }
+    size_t bucket_size(size_t level) const;
+
+    // Summary over samples [begin, end), answered from the coarsest level that
+    // still resolves the range. Edge buckets are included whole.
+    Peak query(size_t begin, size_t end) const;
+
+    // Exact reduction straight from PCM, for spans shorter than a bucket
+    static Peak scan(const s16* data, size_t count);
+
+private:
+    struct Level {
+        std::vector<s16> min;
+        std::vector<s16> max;
+        std::vector<float> sumsq;
+    };
+
+    void rebuild_from(size_t level, size_t first);
+
+    std::vector<Level> lv;
+    size_t total = 0;
+};
+
+#endif // PEAKS_H
@@ -0,0 +1,128 @@
+#include "previewstream.h"
+#include <chrono>
+
+static const size_t RING_FRAMES = 1 << 15;
+
+PreviewStream::PreviewStream() : ring(RING_FRAMES) {}
+
+PreviewStream::~PreviewStream() {
+    close();
+}
+
+void PreviewStream::open(std::shared_ptr<const PendingSample> pending) {
+    close();
+    if (!pending) return;
+
+    sample = std::move(pending);
+    layout = sample->info;
+
+    quit = false;
+    thread = std::thread(&PreviewStream::worker, this);
+}
+
+void PreviewStream::close() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    sample.reset();
+    layout = {};
+    feeding = false;
+    feed_pos = 0;
+    feed_done.store(false, std::memory_order_relaxed);
+    ring.clear();
+    segments.clear();
+}
+
+void PreviewStream::start_feed(bool loop) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ring.clear();
+        segments.clear();
+        feed_pos = 0;
+        feeding = true;
+        looping.store(loop, std::memory_order_relaxed);
+        feed_done.store(false, std::memory_order_relaxed);
+        // Prime with whatever is already decoded so the first callback has data
+        feed();
+    }
+    cv.notify_all();
+}
+
+void PreviewStream::set_loop_points(u32 loop_start, u32 loop_end) {
+    std::lock_guard<std::mutex> lock(mutex);
+    layout.loop_start = loop_start;
+    layout.loop_end = loop_end;
+}
+
+double PreviewStream::play_position() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!feeding || segments.empty()) return -1;
+
+    size_t t = ring.read_index();
+    while (segments.size() > 1 && segments[1].ring_index <= t) segments.pop_front();
+
+    const Segment& s = segments.front();
+    if (t < s.ring_index) return -1;
+    return (double)(s.src_pos + (t - s.ring_index));
+}
+
+void PreviewStream::stop_feed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    feeding = false;
+}
+
+// Called with the mutex held. Returns true if anything was pushed.
+bool PreviewStream::feed() {
+    if (!feeding || feed_done.load(std::memory_order_relaxed)) return false;
+
+    bool pushed = false;
+    size_t total = sample->total();
+    bool loop = looping.load(std::memory_order_relaxed);
+    bool has_loop = layout.looping && layout.loop_end > layout.loop_start;
+    size_t end = (loop && has_loop) ? std::min<size_t>(layout.loop_end, total) : total;
+
+    while (ring.space() > 0) {
+        if (feed_pos >= end) {
+            if (!loop || total == 0) {
+                feed_done.store(true, std::memory_order_release);
+                break;
+            }
+            feed_pos = has_loop ? layout.loop_start : 0;
+        }
+
+        size_t ready = std::min(decoded(), end);
+        if (feed_pos >= ready) break; // decoder hasn't caught up yet
+
+        size_t at = ring.write_index();
+        size_t n = ring.write(layout.pcm->data() + feed_pos, ready - feed_pos);
+        if (n == 0) break;
+        if (segments.empty() || segments.back().src_pos + (at - segments.back().ring_index) != feed_pos)
+            segments.push_back({ at, feed_pos });
+        feed_pos += n;
+        pushed = true;
+    }
+    return pushed;
+}
+
+void PreviewStream::worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!quit) {
+        bool busy = feed();
+
+        // Device drains the ring and the decode queue fills the buffer on their own
+        // schedules, poll at a fraction of a period. Otherwise sleep until start_feed() or close().
+        if (!busy) {
+            if (feeding && !feed_done.load(std::memory_order_relaxed))
+                cv.wait_for(lock, std::chrono::milliseconds(2));
+            else
+                cv.wait(lock);
+        }
+    }
+}
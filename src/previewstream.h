@@ -0,0 +1,76 @@
+#ifndef PREVIEWSTREAM_H
+#define PREVIEWSTREAM_H
+
+#include "main.h"
+#include "bd.h"
+#include "decodequeue.h"
+#include "ringbuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Feeds the preview device through a ring from a sample the decode queue may still be
+// filling, so playback starts after the first chunk instead of after the whole sample.
+class PreviewStream {
+public:
+    PreviewStream();
+    ~PreviewStream();
+
+    void open(std::shared_ptr<const PendingSample> sample);
+    void close();
+    bool is_open() const { return sample != nullptr; }
+
+    // Valid right after open(). pcm is the shared buffer, still filling until finished().
+    const DecodedSample& info() const { return layout; }
+    size_t total_samples() const { return sample ? sample->total() : 0; }
+
+    // buffer()[0, decoded()) is final and safe to read from any thread
+    size_t decoded() const { return sample ? sample->decoded.load(std::memory_order_acquire) : 0; }
+    const PcmBuffer& buffer() const { return layout.pcm; }
+    bool finished() const { return decoded() == total_samples(); }
+
+    // GUI side, device must be stopped around start_feed
+    void start_feed(bool loop);
+    void stop_feed();
+    void set_loop(bool loop) { looping.store(loop, std::memory_order_relaxed); }
+    // Edited loop points, picked up at the next wrap
+    void set_loop_points(u32 loop_start, u32 loop_end);
+
+    // Sample the device is currently being handed, -1 when idle. GUI side, takes the lock.
+    double play_position();
+
+    // Audio thread
+    size_t read(s16* out, size_t frames) { return ring.read(out, frames); }
+    // Nothing left to play and nothing coming (non-looping end)
+    bool exhausted() const { return feed_done.load(std::memory_order_acquire) && ring.available() == 0; }
+
+private:
+    void worker();
+    bool feed();
+
+    std::shared_ptr<const PendingSample> sample;
+    DecodedSample layout; // copy of sample->info with the loop edits applied
+
+    RingBuffer<s16> ring;
+    // Where each contiguous run pushed into the ring came from, so the ring's read
+    // index (advanced by the callback) maps back to a sample position
+    struct Segment {
+        size_t ring_index;
+        size_t src_pos;
+    };
+    std::deque<Segment> segments;
+    size_t feed_pos = 0;
+    bool feeding = false;
+    std::atomic<bool> looping{false};
+    std::atomic<bool> feed_done{false};
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool quit = false;
+};
+
+#endif // PREVIEWSTREAM_H
@@ -0,0 +1,219 @@
+#include "reverb.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+
+// Register order as written to the SPU2 (dAPF1 .. vRIN), plus work area size in bytes.
+struct ReverbPresetData {
+    const char* name;
+    u32 size;
+    u16 regs[32];
+};
+
+static const ReverbPresetData PRESETS[SpuReverb::PresetCount] = {
+    { "Off", 0x10,
+      { 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001,
+        0x0000, 0x0000, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0001, 0x0000, 0x0000, 0x0001, 0x0001, 0x0001, 0x0001, 0x0000, 0x0000 } },
+    { "Room", 0x26C0,
+      { 0x007D, 0x005B, 0x6D80, 0x54B8, 0xBED0, 0x0000, 0x0000, 0xBA80, 0x5800, 0x5300, 0x04D6, 0x0333, 0x03F0, 0x0227, 0x0374, 0x01EF,
+        0x0334, 0x01B5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x01B4, 0x0136, 0x00B8, 0x005C, 0x8000, 0x8000 } },
+    { "Studio Small", 0x1F40,
+      { 0x0033, 0x0025, 0x70F0, 0x4FA8, 0xBCE0, 0x4410, 0xC0F0, 0x9C00, 0x5280, 0x4EC0, 0x03E4, 0x031B, 0x03A4, 0x02AF, 0x0372, 0x0266,
+        0x031C, 0x025D, 0x025C, 0x018E, 0x022F, 0x0135, 0x01D2, 0x00B7, 0x018F, 0x00B5, 0x00B4, 0x0080, 0x004C, 0x0026, 0x8000, 0x8000 } },
+    { "Studio Medium", 0x4840,
+      { 0x00B1, 0x007F, 0x70F0, 0x4FA8, 0xBCE0, 0x4510, 0xBEF0, 0xB4C0, 0x5280, 0x4EC0, 0x0904, 0x076B, 0x0824, 0x065F, 0x07A2, 0x0616,
+        0x076C, 0x05ED, 0x05EC, 0x042E, 0x050F, 0x0305, 0x0462, 0x02B7, 0x042F, 0x0265, 0x0264, 0x01B2, 0x0100, 0x0080, 0x8000, 0x8000 } },
+    { "Studio Large", 0x6FE0,
+      { 0x00E3, 0x00A9, 0x6F60, 0x4FA8, 0xBCE0, 0x4510, 0xBEF0, 0xA680, 0x5680, 0x52C0, 0x0DFB, 0x0B58, 0x0D09, 0x0A3C, 0x0BD9, 0x0973,
+        0x0B59, 0x08DA, 0x08D9, 0x05E9, 0x07EC, 0x04B0, 0x06EF, 0x03D2, 0x05EA, 0x031D, 0x031C, 0x0238, 0x0154, 0x00AA, 0x8000, 0x8000 } },
+    { "Hall", 0xADE0,
+      { 0x01A5, 0x0139, 0x6000, 0x5000, 0x4C00, 0xB800, 0xBC00, 0xC000, 0x6000, 0x5C00, 0x15BA, 0x11BB, 0x14C2, 0x10BD, 0x11BC, 0x0DC1,
+        0x11C0, 0x0DC3, 0x0DC0, 0x09C1, 0x0BC4, 0x07C1, 0x0A00, 0x06CD, 0x09C2, 0x05C1, 0x05C0, 0x041A, 0x0274, 0x013A, 0x8000, 0x8000 } },
+    { "Half Echo", 0x3C00,
+      { 0x0017, 0x0013, 0x70F0, 0x4FA8, 0xBCE0, 0x4510, 0xBEF0, 0x8500, 0x5F80, 0x54C0, 0x0371, 0x02AF, 0x02E5, 0x01DF, 0x02B0, 0x01D7,
+        0x0358, 0x026A, 0x01D6, 0x011E, 0x012D, 0x00B1, 0x011F, 0x0059, 0x01A0, 0x00E3, 0x0058, 0x0040, 0x0028, 0x0014, 0x8000, 0x8000 } },
+    { "Space Echo", 0xF6C0,
+      { 0x033D, 0x0231, 0x7E00, 0x5000, 0xB400, 0xB000, 0x4C00, 0xB000, 0x6000, 0x5400, 0x1ED6, 0x1A31, 0x1D14, 0x183B, 0x1BC2, 0x16B2,
+        0x1A32, 0x15EF, 0x15EE, 0x1055, 0x1334, 0x0F2D, 0x11F6, 0x0C5D, 0x1056, 0x0AE1, 0x0AE0, 0x07A2, 0x0464, 0x0232, 0x8000, 0x8000 } },
+    { "Chaos Echo", 0x18040,
+      { 0x0001, 0x0001, 0x7FFF, 0x7FFF, 0x0000, 0x0000, 0x0000, 0x8100, 0x0000, 0x0000, 0x1FFF, 0x0FFF, 0x1005, 0x0005, 0x0000, 0x0000,
+        0x1005, 0x0005, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x1004, 0x1002, 0x0004, 0x0002, 0x8000, 0x8000 } },
+    { "Delay", 0x18040,
+      { 0x0001, 0x0001, 0x7FFF, 0x7FFF, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x1FFF, 0x0FFF, 0x1005, 0x0005, 0x0000, 0x0000,
+        0x1005, 0x0005, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x1004, 0x1002, 0x0004, 0x0002, 0x8000, 0x8000 } },
+};
+
+// Hardware runs the reverb at 22050Hz, one halfword step per tick
+static const double REVERB_RATE = 22050.0;
+
+const char* SpuReverb::preset_name(int preset) {
+    if (preset < 0 || preset >= PresetCount) return "";
+    return PRESETS[preset].name;
+}
+
+static inline float vol(u16 reg) {
+    return (float)(s16)reg / 32768.0f;
+}
+
+void SpuReverb::configure(int preset, u32 sample_rate) {
+    active = false;
+    ram.clear();
+    pos = 0;
+    if (preset <= Off || preset >= PresetCount || sample_rate == 0) return;
+
+    const ReverbPresetData& p = PRESETS[preset];
+    const u16* r = p.regs;
+
+    // The preview runs at the sample's own rate, so stretch the delay lines to keep their length in time
+    double scale = sample_rate / REVERB_RATE;
+    u32 size = (u32)std::ceil((p.size / 2) * scale);
+    if (size < 2) return;
+
+    auto addr = [&](u16 reg) -> u32 {
+        return (u32)std::lround(reg * 4 * scale) % size;
+    };
+    auto back = [&](u32 a, u32 d) -> u32 {
+        return (a + size - (d % size)) % size;
+    };
+
+    u32 dAPF1 = addr(r[0]);
+    u32 dAPF2 = addr(r[1]);
+    vIIR = vol(r[2]);
+    vCOMB[0] = vol(r[3]); vCOMB[1] = vol(r[4]); vCOMB[2] = vol(r[5]); vCOMB[3] = vol(r[6]);
+    vWALL = vol(r[7]);
+    vAPF1 = vol(r[8]);
+    vAPF2 = vol(r[9]);
+
+    taps.mLSAME = addr(r[10]); taps.mRSAME = addr(r[11]);
+    taps.mLCOMB[0] = addr(r[12]); taps.mRCOMB[0] = addr(r[13]);
+    taps.mLCOMB[1] = addr(r[14]); taps.mRCOMB[1] = addr(r[15]);
+    taps.dLSAME = addr(r[16]); taps.dRSAME = addr(r[17]);
+    taps.mLDIFF = addr(r[18]); taps.mRDIFF = addr(r[19]);
+    taps.mLCOMB[2] = addr(r[20]); taps.mRCOMB[2] = addr(r[21]);
+    taps.mLCOMB[3] = addr(r[22]); taps.mRCOMB[3] = addr(r[23]);
+    taps.dLDIFF = addr(r[24]); taps.dRDIFF = addr(r[25]);
+    taps.mLAPF1 = addr(r[26]); taps.mRAPF1 = addr(r[27]);
+    taps.mLAPF2 = addr(r[28]); taps.mRAPF2 = addr(r[29]);
+    vLIN = vol(r[30]);
+    vRIN = vol(r[31]);
+
+    taps.pLSAME = back(taps.mLSAME, 1); taps.pRSAME = back(taps.mRSAME, 1);
+    taps.pLDIFF = back(taps.mLDIFF, 1); taps.pRDIFF = back(taps.mRDIFF, 1);
+    taps.aLAPF1 = back(taps.mLAPF1, dAPF1); taps.aRAPF1 = back(taps.mRAPF1, dAPF1);
+    taps.aLAPF2 = back(taps.mLAPF2, dAPF2); taps.aRAPF2 = back(taps.mRAPF2, dAPF2);
+
+    ram.assign(size, 0.0f);
+    active = true;
+}
+
+void SpuReverb::reset() {
+    std::fill(ram.begin(), ram.end(), 0.0f);
+    pos = 0;
+}
+
+void SpuReverb::process(s16* buf, u32 frames) {
+    if (!active) return;
+
+    float* m = ram.data();
+    const u32 size = (u32)ram.size();
+    const Taps& t = taps;
+    u32 p = pos;
+
+    auto at = [&](u32 off) -> float& {
+        u32 i = p + off;
+        if (i >= size) i -= size;
+        return m[i];
+    };
+
+#if PS2SND_SSE2
+    // Lanes: LSAME, RSAME, LDIFF, RDIFF for the reflections,
+    // then {L comb 1/2, R comb 1/2} + {L comb 3/4, R comb 3/4} and {L, R} for the all-pass stages
+    const __m128 iir = _mm_set1_ps(vIIR);
+    const __m128 wall = _mm_set1_ps(vWALL);
+    const __m128 lin = _mm_set_ps(vRIN, vLIN, vRIN, vLIN);
+    const __m128 comb_a = _mm_set_ps(vCOMB[1], vCOMB[0], vCOMB[1], vCOMB[0]);
+    const __m128 comb_b = _mm_set_ps(vCOMB[3], vCOMB[2], vCOMB[3], vCOMB[2]);
+    const __m128 apf1 = _mm_set1_ps(vAPF1);
+    const __m128 apf2 = _mm_set1_ps(vAPF2);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f / 32768.0f);
+    alignas(16) float lane[4];
+
+    for (u32 i = 0; i < frames; ++i) {
+        __m128 in = _mm_mul_ps(_mm_set1_ps(buf[i] / 32768.0f), lin);
+
+        __m128 wallv = _mm_set_ps(at(t.dLDIFF), at(t.dRDIFF), at(t.dRSAME), at(t.dLSAME));
+        __m128 prev = _mm_set_ps(at(t.pRDIFF), at(t.pLDIFF), at(t.pRSAME), at(t.pLSAME));
+        __m128 refl = _mm_sub_ps(_mm_add_ps(in, _mm_mul_ps(wallv, wall)), prev);
+        refl = _mm_add_ps(_mm_mul_ps(refl, iir), prev);
+        refl = _mm_min_ps(_mm_max_ps(refl, lo), hi);
+        _mm_store_ps(lane, refl);
+        at(t.mLSAME) = lane[0]; at(t.mRSAME) = lane[1];
+        at(t.mLDIFF) = lane[2]; at(t.mRDIFF) = lane[3];
+
+        __m128 c = _mm_add_ps(
+            _mm_mul_ps(_mm_set_ps(at(t.mRCOMB[1]), at(t.mRCOMB[0]), at(t.mLCOMB[1]), at(t.mLCOMB[0])), comb_a),
+            _mm_mul_ps(_mm_set_ps(at(t.mRCOMB[3]), at(t.mRCOMB[2]), at(t.mLCOMB[3]), at(t.mLCOMB[2])), comb_b));
+        // {L0+L1, R0+R1} in lanes 0/1
+        __m128 out = _mm_add_ps(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 2, 0)),
+                                _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 1)));
+
+        __m128 a = _mm_set_ps(0.0f, 0.0f, at(t.aRAPF1), at(t.aLAPF1));
+        out = _mm_min_ps(_mm_max_ps(_mm_sub_ps(out, _mm_mul_ps(apf1, a)), lo), hi);
+        _mm_store_ps(lane, out);
+        at(t.mLAPF1) = lane[0]; at(t.mRAPF1) = lane[1];
+        out = _mm_add_ps(_mm_mul_ps(out, apf1), a);
+
+        a = _mm_set_ps(0.0f, 0.0f, at(t.aRAPF2), at(t.aLAPF2));
+        out = _mm_min_ps(_mm_max_ps(_mm_sub_ps(out, _mm_mul_ps(apf2, a)), lo), hi);
+        _mm_store_ps(lane, out);
+        at(t.mLAPF2) = lane[0]; at(t.mRAPF2) = lane[1];
+        out = _mm_add_ps(_mm_mul_ps(out, apf2), a);
+        _mm_store_ps(lane, out);
+
+        float wet = (lane[0] + lane[1]) * 0.5f * wet_mix;
+        float mixed = buf[i] + wet * 32768.0f;
+        buf[i] = (s16)std::clamp(mixed, -32768.0f, 32767.0f);
+
+        if (++p >= size) p = 0;
+    }
+#else
+    auto sat = [](float v) { return std::clamp(v, -1.0f, 32767.0f / 32768.0f); };
+
+    for (u32 i = 0; i < frames; ++i) {
+        float in = buf[i] / 32768.0f;
+        float Lin = in * vLIN, Rin = in * vRIN;
+
+        float ls = sat((Lin + at(t.dLSAME) * vWALL - at(t.pLSAME)) * vIIR + at(t.pLSAME));
+        float rs = sat((Rin + at(t.dRSAME) * vWALL - at(t.pRSAME)) * vIIR + at(t.pRSAME));
+        float ld = sat((Lin + at(t.dRDIFF) * vWALL - at(t.pLDIFF)) * vIIR + at(t.pLDIFF));
+        float rd = sat((Rin + at(t.dLDIFF) * vWALL - at(t.pRDIFF)) * vIIR + at(t.pRDIFF));
+        at(t.mLSAME) = ls; at(t.mRSAME) = rs;
+        at(t.mLDIFF) = ld; at(t.mRDIFF) = rd;
+
+        float L = 0, R = 0;
+        for (int c = 0; c < 4; ++c) {
+            L += vCOMB[c] * at(t.mLCOMB[c]);
+            R += vCOMB[c] * at(t.mRCOMB[c]);
+        }
+
+        float al = at(t.aLAPF1), ar = at(t.aRAPF1);
+        L = sat(L - vAPF1 * al); R = sat(R - vAPF1 * ar);
+        at(t.mLAPF1) = L; at(t.mRAPF1) = R;
+        L = L * vAPF1 + al; R = R * vAPF1 + ar;
+
+        al = at(t.aLAPF2); ar = at(t.aRAPF2);
+        L = sat(L - vAPF2 * al); R = sat(R - vAPF2 * ar);
+        at(t.mLAPF2) = L; at(t.mRAPF2) = R;
+        L = L * vAPF2 + al; R = R * vAPF2 + ar;
+
+        float wet = (L + R) * 0.5f * wet_mix;
+        float mixed = buf[i] + wet * 32768.0f;
+        buf[i] = (s16)std::clamp(mixed, -32768.0f, 32767.0f);
+
+        if (++p >= size) p = 0;
+    }
+#endif
+
+    pos = p;
+}
@@ -0,0 +1,46 @@
+#ifndef REVERB_H
+#define REVERB_H
+
+#include "main.h"
+#include <vector>
+
+// SPU2 reverb work area emulation. Register sets are the standard libsd presets,
+// offsets are in 8-byte units relative to the buffer address like on hardware.
+class SpuReverb {
+public:
+    enum Preset {
+        Off, Room, StudioSmall, StudioMedium, StudioLarge,
+        Hall, HalfEcho, SpaceEcho, ChaosEcho, Delay, PresetCount
+    };
+
+    static const char* preset_name(int preset);
+
+    void configure(int preset, u32 sample_rate);
+    void reset();
+    bool enabled() const { return active; }
+
+    // Mono block in place: dry input feeds both sides, wet L/R is folded back on top
+    void process(s16* buf, u32 frames);
+
+private:
+    // Everything pre-wrapped to [0, size) so the inner loop only adds pos
+    struct Taps {
+        u32 mLSAME, mRSAME, mLDIFF, mRDIFF;     // reflection writes
+        u32 pLSAME, pRSAME, pLDIFF, pRDIFF;     // same addresses minus one step
+        u32 dLSAME, dRSAME, dLDIFF, dRDIFF;     // wall reads
+        u32 mLCOMB[4], mRCOMB[4];
+        u32 mLAPF1, mRAPF1, mLAPF2, mRAPF2;
+        u32 aLAPF1, aRAPF1, aLAPF2, aRAPF2;     // mXAPFn - dAPFn
+    };
+
+    bool active = false;
+    Taps taps = {};
+    float vIIR = 0, vWALL = 0, vAPF1 = 0, vAPF2 = 0, vLIN = 0, vRIN = 0;
+    float vCOMB[4] = {};
+    float wet_mix = 0.5f;
+
+    std::vector<float> ram;
+    u32 pos = 0;
+};
+
+#endif // REVERB_H
@@ -0,0 +1,73 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+// Single producer / single consumer, lock-free. Capacity is rounded up to a power of two.
+template<typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        buf.resize(cap);
+        mask = cap - 1;
+    }
+
+    size_t capacity() const { return buf.size(); }
+
+    size_t available() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t space() const { return capacity() - available(); }
+
+    // Running totals, never wrapped: frames written so far / frames consumed so far
+    size_t write_index() const { return head.load(std::memory_order_acquire); }
+    size_t read_index() const { return tail.load(std::memory_order_acquire); }
+
+    // Producer side
+    size_t write(const T* src, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        count = std::min(count, capacity() - (h - t));
+
+        size_t first = std::min(count, capacity() - (h & mask));
+        std::memcpy(buf.data() + (h & mask), src, first * sizeof(T));
+        std::memcpy(buf.data(), src + first, (count - first) * sizeof(T));
+
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side
+    size_t read(T* dst, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        count = std::min(count, h - t);
+
+        size_t first = std::min(count, capacity() - (t & mask));
+        std::memcpy(dst, buf.data() + (t & mask), first * sizeof(T));
+        std::memcpy(dst + first, buf.data(), (count - first) * sizeof(T));
+
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    // Only while neither side is running
+    void clear() {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> buf;
+    size_t mask = 0;
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+#endif // RINGBUFFER_H
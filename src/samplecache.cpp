@@ -0,0 +1,48 @@
+#include "samplecache.h"
+
+bool SampleCache::get(u64 key, DecodedSample& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) return false;
+
+    lru.splice(lru.begin(), lru, it->second.lru_it);
+    out = it->second.sample;
+    return true;
+}
+
+void SampleCache::put(u64 key, const DecodedSample& sample) {
+    if (!sample.pcm) return;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        bytes -= cost(it->second.sample);
+        it->second.sample = sample;
+        bytes += cost(sample);
+        lru.splice(lru.begin(), lru, it->second.lru_it);
+    } else {
+        lru.push_front(key);
+        entries[key] = { sample, lru.begin() };
+        bytes += cost(sample);
+    }
+
+    // Keep at least the newest entry even if it alone blows the budget
+    while (bytes > budget && lru.size() > 1) {
+        auto victim = entries.find(lru.back());
+        bytes -= cost(victim->second.sample);
+        entries.erase(victim);
+        lru.pop_back();
+    }
+}
+
+void SampleCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    lru.clear();
+    bytes = 0;
+}
+
+size_t SampleCache::size_bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes;
+}
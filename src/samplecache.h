@@ -0,0 +1,38 @@
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include "main.h"
+#include "bd.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// LRU of decoded samples. Entries share their PCM with whoever else holds them,
+// so eviction only frees memory once the widget/player let go too.
+// Decode workers put from their own threads, so every call takes the lock.
+class SampleCache {
+public:
+    explicit SampleCache(size_t budget_bytes = 256u << 20) : budget(budget_bytes) {}
+
+    bool get(u64 key, DecodedSample& out);
+    void put(u64 key, const DecodedSample& sample);
+    void clear();
+
+    size_t size_bytes();
+
+private:
+    struct Entry {
+        DecodedSample sample;
+        std::list<u64>::iterator lru_it;
+    };
+
+    static size_t cost(const DecodedSample& s) { return s.pcm ? s.pcm->size() * sizeof(s16) : 0; }
+
+    std::mutex mutex;
+    size_t budget;
+    size_t bytes = 0;
+    std::list<u64> lru;   // front = most recent
+    std::unordered_map<u64, Entry> entries;
+};
+
+#endif // SAMPLECACHE_H
@@ -0,0 +1,58 @@
+#include "samplestore.h"
+#include <cstring>
+
+static const u32 NONE = 0xFFFFFFFF;
+
+u32 SampleStore::add(const BDParser& bd, const Tone& tone) {
+    u64 where = ((u64)tone.sample_rate << 32) | tone.bd_offset;
+    auto loc = by_location.find({ &bd, where });
+    if (loc != by_location.end()) {
+        entries[loc->second].refs++;
+        return loc->second;
+    }
+    return add(bd, tone, bd.scan_sample(tone.bd_offset));
+}
+
+u32 SampleStore::add(const BDParser& bd, const Tone& tone, const SampleSpan& span) {
+    u64 where = ((u64)tone.sample_rate << 32) | tone.bd_offset;
+    auto loc = by_location.find({ &bd, where });
+    if (loc != by_location.end()) {
+        entries[loc->second].refs++;
+        return loc->second;
+    }
+
+    u64 key = span.hash ^ ((u64)tone.sample_rate * 0x9E3779B97F4A7C15ull);
+
+    // The hash only finds candidates, the bytes decide: a collision must not swap audio
+    u32 idx = NONE;
+    auto range = by_content.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry& e = entries[it->second];
+        if (e.size == span.size && e.sample_rate == tone.sample_rate
+            && std::memcmp(e.bd->bytes(e.offset), bd.bytes(tone.bd_offset), span.size) == 0) {
+            idx = it->second;
+            break;
+        }
+    }
+    if (idx != NONE) {
+        dup_locations++;
+        saved += pcm_bytes(span.size);
+    } else {
+        idx = (u32)entries.size();
+        entries.push_back({ key, &bd, tone.bd_offset, span.size, tone.sample_rate,
+                            tone.root_key, tone.pitch_fine, span.looping });
+        by_content.emplace(key, idx);
+    }
+
+    by_location[{ &bd, where }] = idx;
+    entries[idx].refs++;
+    return idx;
+}
+
+void SampleStore::clear() {
+    entries.clear();
+    by_content.clear();
+    by_location.clear();
+    dup_locations = 0;
+    saved = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef SAMPLESTORE_H
+#define SAMPLESTORE_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Content-addressed set of the samples an export writes. Tones map to entries by what
+// their ADPCM holds plus the rate (the SF2 sample header carries it), so the same data
+// at another offset or in another bank becomes one more reference to a single entry.
+// Tones sharing an entry can still differ in root key and fine tune, so writers tune
+// each zone from its own tone; the entry's pair is only the sample's default.
+class SampleStore {
+public:
+    struct Entry {
+        u64 key;
+        const BDParser* bd; // where it was first seen, decode from there
+        u32 offset;
+        u32 size;           // ADPCM bytes
+        u32 sample_rate;
+        u8 root_key;        // from the first tone, zones override it
+        s8 pitch_fine;
+        bool looping;
+        u32 refs = 0;       // tones using it
+    };
+
+    // Entry index for the tone's sample, added on first sight. Its offset must be inside the BD.
+    u32 add(const BDParser& bd, const Tone& tone);
+    // Same, with the boundary scan already done (e.g. on a worker). The span must not
+    // be empty, entries are read straight from the BD at their offset.
+    u32 add(const BDParser& bd, const Tone& tone, const SampleSpan& span);
+    void clear();
+
+    size_t size() const { return entries.size(); }
+    const Entry& entry(u32 i) const { return entries[i]; }
+
+    // Locations (other offsets, other banks) that turned out to hold data already in
+    // the store, and the decoded PCM bytes each would otherwise have written again
+    size_t duplicates() const { return dup_locations; }
+    u64 saved_bytes() const { return saved; }
+
+    static u64 pcm_bytes(u32 adpcm_bytes) { return (u64)adpcm_bytes / 16 * 28 * sizeof(s16); }
+
+private:
+    std::vector<Entry> entries;
+    std::unordered_multimap<u64, u32> by_content; // hash hits are confirmed byte for byte
+    // Each (BD, offset, rate) is scanned once, however many tones point at it
+    std::map<std::pair<const BDParser*, u64>, u32> by_location;
+    size_t dup_locations = 0;
+    u64 saved = 0;
+};
+
+#endif // SAMPLESTORE_H
@@ -0,0 +1,246 @@
+#include "sf2import.h"
+#include "sf2reader.h"
+#include "hd.h"
+#include "bd.h"
+#include "adsr.h"
+#include "hdwriter.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+// Sony's VAG attribute values
+static const u8 VAG_1SHOT = 0x00;
+static const u8 VAG_LOOP = 0xFF;
+// Split blocks start here in a program entry, the bytes in between are LFO settings
+static const u32 PROG_HEADER_SIZE = 0x20;
+// The parser reads at most this many samples per sample set
+static const size_t MAX_SET_SAMPLES = 16;
+
+template <typename T>
+static std::vector<u8> bytes_of(const T& v) {
+    std::vector<u8> b(sizeof(T));
+    std::memcpy(b.data(), &v, sizeof(T));
+    return b;
+}
+
+static u8 to_panpot(s16 pan) {
+    return (u8)std::clamp(0x40 + (int)std::lround(pan * 64.0 / 500.0), 0, 127);
+}
+
+namespace {
+// A sample range as some zone plays it, after the zone's address offsets
+struct VagSource {
+    u32 start, end, loop_start, loop_end;
+    bool looping;
+    u32 sample_rate;
+    bool operator<(const VagSource& o) const {
+        return std::tie(start, end, loop_start, loop_end, looping, sample_rate)
+             < std::tie(o.start, o.end, o.loop_start, o.loop_end, o.looping, o.sample_rate);
+    }
+};
+}
+
+bool Sf2Importer::import(const QString& sf2_path, const QString& hd_path, const QString& bd_path, VagEncoder::Mode mode, int sf2_bank) {
+    auto t0 = std::chrono::steady_clock::now();
+
+    Sf2Reader sf2;
+    if (!sf2.load(sf2_path)) return false;
+    const std::vector<Sf2Sample>& samples = sf2.samples();
+    u32 frames = (u32)sf2.pcm_size();
+
+    // Presets in (bank, program) order, one per program number
+    std::vector<const Sf2Preset*> presets;
+    for (const Sf2Preset& p : sf2.presets()) {
+        if (p.program > 127 || p.zones.empty()) continue;
+        if (sf2_bank >= 0 && p.bank != sf2_bank) continue;
+        presets.push_back(&p);
+    }
+    std::stable_sort(presets.begin(), presets.end(), [](const Sf2Preset* a, const Sf2Preset* b) {
+        return a->bank != b->bank ? a->bank < b->bank : a->program < b->program;
+    });
+    std::vector<const Sf2Preset*> byProgram(128, nullptr);
+    size_t dropped = 0;
+    for (const Sf2Preset* p : presets) {
+        if (byProgram[p->program]) dropped++;
+        else byProgram[p->program] = p;
+    }
+    if (dropped) LogInfo("SF2 import: " + std::to_string(dropped) + " presets share a program number with an earlier bank, skipped");
+
+    auto tables = std::make_shared<HdTables>();
+    std::memset(&tables->vers, 0, sizeof(VersCk));
+    tables->vers.major = 3;
+    tables->vers.minor = 1;
+    std::memset(&tables->head, 0, sizeof(HdrCk));
+
+    std::map<VagSource, u32> vagIndex;
+    std::vector<VagSource> vagList;
+    int lastProgram = -1;
+    for (int prog = 0; prog < 128; ++prog) if (byProgram[prog]) lastProgram = prog;
+    tables->programs.resize(lastProgram + 1);
+
+    for (int prog = 0; prog <= lastProgram; ++prog) {
+        const Sf2Preset* preset = byProgram[prog];
+        if (!preset) continue;
+
+        // A split per distinct key range, its zones (velocity layers, stereo pairs) share a set
+        std::vector<std::pair<u8, u8>> ranges;
+        std::vector<std::vector<u16>> setSamples;
+        for (const Sf2Zone& z : preset->zones) {
+            const Sf2Sample& s = samples[z.sample];
+
+            VagSource src;
+            s64 start = (s64)s.start + z.start_offset, end = (s64)s.end + z.end_offset;
+            s64 ls = (s64)s.loop_start + z.loop_start_offset, le = (s64)s.loop_end + z.loop_end_offset;
+            start = std::clamp<s64>(start, 0, frames);
+            end = std::clamp<s64>(end, start, frames);
+            if (end <= start) continue;
+            src.start = (u32)start;
+            src.end = (u32)end;
+            src.looping = z.looping && ls >= start && le <= end && ls < le;
+            src.loop_start = src.looping ? (u32)(ls - start) : 0;
+            src.loop_end = src.looping ? (u32)(le - start) : 0;
+            // VAGInfo keeps the rate in 16 bits, clamping it would play the sample detuned
+            if (s.sample_rate > 0xFFFF) {
+                LogErr("SF2 import: sample " + std::to_string(z.sample) + " is at " + std::to_string(s.sample_rate)
+                       + " Hz, an HD holds at most 65535 Hz");
+                return false;
+            }
+            src.sample_rate = s.sample_rate;
+
+            auto vi = vagIndex.find(src);
+            if (vi == vagIndex.end()) {
+                // VagIndex and the sample-set entries are 16 bit, past that they would wrap
+                if (vagList.size() > 0xFFFF) {
+                    LogErr("SF2 import: more than 65536 distinct sample ranges, an HD cannot index them");
+                    return false;
+                }
+                vi = vagIndex.emplace(src, (u32)vagList.size()).first;
+                vagList.push_back(src);
+            }
+
+            int root = z.root_key >= 0 ? z.root_key : (s.root_key <= 127 ? s.root_key : 60);
+            u32 reg = HardwareADSR::nearest_register(z.attack_tc, z.decay_tc, z.sustain_cb, z.release_tc);
+
+            SampleParam sp = {};
+            sp.VagIndex = (u16)vi->second;
+            sp.velRangeLow = z.vel_lo;
+            sp.velRangeHigh = z.vel_hi;
+            sp.velFollowAmpCenter = 0x40;
+            sp.velFollowPitchCenter = 0x40;
+            sp.sampleBaseNote = (u8)std::clamp(root - z.coarse_tune, 0, 127);
+            sp.sampleDetune = (s8)std::clamp(z.fine_tune + s.correction, -99, 99);
+            sp.samplePanpot = to_panpot(z.pan);
+            sp.samplePriority = 0x7F;
+            sp.sampleVolume = (u8)std::lround(127.0 * std::pow(10.0, -z.attenuation_cb / 200.0));
+            sp.sampleAdsr1 = (u16)reg;
+            sp.sampleAdsr2 = (u16)(reg >> 16);
+
+            size_t r = 0;
+            while (r < ranges.size() && (ranges[r] != std::make_pair(z.key_lo, z.key_hi) || setSamples[r].size() >= MAX_SET_SAMPLES)) ++r;
+            if (r == ranges.size()) {
+                ranges.push_back({ z.key_lo, z.key_hi });
+                setSamples.emplace_back();
+            }
+            if (tables->samples.size() > 0xFFFF) {
+                LogErr("SF2 import: more than 65536 zones, an HD cannot index them");
+                return false;
+            }
+            setSamples[r].push_back((u16)tables->samples.size());
+            tables->samples.push_back(bytes_of(sp));
+        }
+        if (ranges.empty()) continue;
+        // The parser ignores a program with more splits than this, dropping the rest would lose keys
+        if (ranges.size() > 128 || tables->sample_sets.size() + ranges.size() > 0x10000) {
+            LogErr("SF2 import: program " + std::to_string(prog) + " needs " + std::to_string(ranges.size())
+                   + " splits, an HD program holds at most 128 (and 65536 sets in all)");
+            return false;
+        }
+
+        ProgParam pp = {};
+        pp.splitBlockAddr = PROG_HEADER_SIZE;
+        pp.nSplit = (u8)ranges.size();
+        pp.sizeSplitBlock = sizeof(SplitBlock);
+        pp.progVolume = 127;
+        pp.progPanpot = 0x40;
+        pp.keyFollowPanCenter = 0x40;
+
+        std::vector<u8> entry = bytes_of(pp);
+        entry.resize(PROG_HEADER_SIZE, 0);
+        for (size_t r = 0; r < pp.nSplit; ++r) {
+            SampleSetParam ss = {};
+            ss.velLimitHigh = 127;
+            ss.nSample = (u8)setSamples[r].size();
+            std::vector<u8> set = bytes_of(ss);
+            for (u16 idx : setSamples[r]) {
+                set.push_back((u8)idx);
+                set.push_back((u8)(idx >> 8));
+            }
+
+            SplitBlock sb = {};
+            sb.sampleSetIndex = (u16)tables->sample_sets.size();
+            sb.splitRangeLow = ranges[r].first;
+            sb.splitRangeHigh = ranges[r].second;
+            sb.splitNumber = (u8)r;
+            sb.kfPitchCenter = sb.kfAmpCenter = sb.kfPanCenter = 0x40;
+            sb.splitVolume = 127;
+            sb.splitPanpot = 0x40;
+            tables->sample_sets.push_back(std::move(set));
+
+            std::vector<u8> split = bytes_of(sb);
+            entry.insert(entry.end(), split.begin(), split.end());
+        }
+        tables->programs[prog] = std::move(entry);
+    }
+
+    if (vagList.empty()) {
+        LogErr("SF2 import: no usable zones");
+        return false;
+    }
+
+    // Encode every distinct range, longest first so the pool stays busy to the end
+    std::vector<std::vector<u8>> encoded(vagList.size());
+    {
+        std::vector<size_t> order(vagList.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return vagList[a].end - vagList[a].start > vagList[b].end - vagList[b].start;
+        });
+
+        WorkerPool pool;
+        for (size_t i : order) {
+            pool.submit([&, i] {
+                const VagSource& v = vagList[i];
+                encoded[i] = VagEncoder::encode(sf2.pcm() + v.start, v.end - v.start, mode, v.looping, v.loop_start, v.loop_end);
+            });
+        }
+        pool.wait_idle();
+    }
+
+    // BD image in memory, HDWriter dedupes identical encodes and lays out the final file
+    std::vector<u8> bdData(16, 0);
+    for (size_t i = 0; i < vagList.size(); ++i) {
+        VAGInfoParam vp = {};
+        vp.vagOffsetAddr = (u32)bdData.size();
+        vp.vagSampleRate = (u16)vagList[i].sample_rate;
+        vp.vagAttribute = vagList[i].looping ? VAG_LOOP : VAG_1SHOT;
+        tables->vags.push_back(bytes_of(vp));
+        bdData.insert(bdData.end(), encoded[i].begin(), encoded[i].end());
+        std::vector<u8>().swap(encoded[i]);
+    }
+
+    Bank bank;
+    bank.tables = tables;
+    bank.valid = true;
+    BDParser bd;
+    bd.assign(std::move(bdData));
+    if (!HDWriter::write(hd_path, bd_path, bank, bd)) return false;
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LogInfo("SF2 import: " + std::to_string(tables->samples.size()) + " zones, " + std::to_string(vagList.size())
+            + " samples in " + std::to_string(secs) + " s");
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef SF2IMPORT_H
+#define SF2IMPORT_H
+
+#include "main.h"
+#include "vagencoder.h"
+#include <QString>
+
+// SF2 -> HD/BD. Presets become programs (program number = preset number), each distinct
+// key range of a preset a split, each zone a sample entry with its envelope mapped to the
+// nearest ADSR register. The distinct sample ranges are VAG-encoded in parallel and the
+// result goes out through HDWriter.
+class Sf2Importer {
+public:
+    // sf2_bank: only presets of that SF2 bank, -1 = all of them (first one per program wins)
+    static bool import(const QString& sf2_path, const QString& hd_path, const QString& bd_path,
+                       VagEncoder::Mode mode = VagEncoder::Quality, int sf2_bank = -1);
+};
+
+#endif // SF2IMPORT_H
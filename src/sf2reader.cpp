@@ -0,0 +1,285 @@
+#include "sf2reader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+// SF2 2.01 generator operators the import looks at
+enum : u16 {
+    GEN_START_ADDRS_OFFSET = 0,
+    GEN_END_ADDRS_OFFSET = 1,
+    GEN_STARTLOOP_ADDRS_OFFSET = 2,
+    GEN_ENDLOOP_ADDRS_OFFSET = 3,
+    GEN_START_ADDRS_COARSE_OFFSET = 4,
+    GEN_END_ADDRS_COARSE_OFFSET = 12,
+    GEN_PAN = 17,
+    GEN_ATTACK_VOL_ENV = 34,
+    GEN_DECAY_VOL_ENV = 36,
+    GEN_SUSTAIN_VOL_ENV = 37,
+    GEN_RELEASE_VOL_ENV = 38,
+    GEN_INSTRUMENT = 41,
+    GEN_KEY_RANGE = 43,
+    GEN_VEL_RANGE = 44,
+    GEN_STARTLOOP_ADDRS_COARSE_OFFSET = 45,
+    GEN_INITIAL_ATTENUATION = 48,
+    GEN_ENDLOOP_ADDRS_COARSE_OFFSET = 50,
+    GEN_COARSE_TUNE = 51,
+    GEN_FINE_TUNE = 52,
+    GEN_SAMPLE_ID = 53,
+    GEN_SAMPLE_MODES = 54,
+    GEN_OVERRIDING_ROOT_KEY = 58,
+    GEN_COUNT = 61,
+};
+
+static const u16 SAMPLE_TYPE_ROM = 0x8000;
+
+namespace {
+// Generator values of one zone, or a zone merged with its global zone
+struct Gens {
+    s16 v[GEN_COUNT] = {};
+    bool set[GEN_COUNT] = {};
+
+    void put(u16 oper, s16 amount) {
+        if (oper >= GEN_COUNT) return;
+        v[oper] = amount;
+        set[oper] = true;
+    }
+    // Local values win over the global zone's
+    void under(const Gens& global) {
+        for (int i = 0; i < GEN_COUNT; ++i) {
+            if (!set[i] && global.set[i]) {
+                v[i] = global.v[i];
+                set[i] = true;
+            }
+        }
+    }
+    s16 get(u16 oper, s16 def) const { return set[oper] ? v[oper] : def; }
+    u8 lo(u16 oper) const { return set[oper] ? (u8)(v[oper] & 0xFF) : 0; }
+    u8 hi(u16 oper) const { return set[oper] ? (u8)((u16)v[oper] >> 8) : 127; }
+};
+
+struct Reader {
+    const std::vector<u8>& b;
+    size_t pos;
+    u8 u8_() { return b[pos++]; }
+    u16 u16_() { u16 v = b[pos] | (b[pos + 1] << 8); pos += 2; return v; }
+    u32 u32_() { u32 v = u16_(); return v | ((u32)u16_() << 16); }
+    std::string name() {
+        const char* p = reinterpret_cast<const char*>(b.data() + pos);
+        pos += 20;
+        return std::string(p, strnlen(p, 20));
+    }
+};
+
+struct InstHeader {
+    std::string name;
+    u16 bag;
+};
+}
+
+static Gens read_zone(const std::vector<u8>& gens, size_t from, size_t to) {
+    Gens g;
+    for (size_t i = from; i < to; ++i) {
+        Reader r{ gens, i * 4 };
+        u16 oper = r.u16_();
+        g.put(oper, (s16)r.u16_());
+    }
+    return g;
+}
+
+// Zones of one bag range, the first counts as global when it does not end in `terminal`
+static void split_zones(const std::vector<u16>& bags, const std::vector<u8>& gens, size_t bagFrom, size_t bagTo,
+                        u16 terminal, Gens& global, std::vector<Gens>& local) {
+    size_t genCount = gens.size() / 4;
+    for (size_t b = bagFrom; b < bagTo && b + 1 < bags.size(); ++b) {
+        size_t from = bags[b], to = std::min<size_t>(bags[b + 1], genCount);
+        if (from > to) continue;
+        Gens z = read_zone(gens, from, to);
+        if (z.set[terminal]) local.push_back(z);
+        else if (b == bagFrom) global = z;
+    }
+}
+
+static s16 clamp_add(s16 a, s16 b, int lo, int hi) {
+    return (s16)std::clamp((int)a + b, lo, hi);
+}
+
+bool Sf2Reader::load(const QString& path) {
+    presetList.clear();
+    sampleList.clear();
+    smpl.clear();
+    LogInfo("Loading SF2: " + path.toStdString());
+
+    std::ifstream file(path.toStdString(), std::ios::binary);
+    if (!file.is_open()) {
+        LogErr("Could not open SF2 file.");
+        return false;
+    }
+
+    auto read32 = [&](u32& v) {
+        u8 b[4];
+        if (!file.read(reinterpret_cast<char*>(b), 4)) return false;
+        v = b[0] | (b[1] << 8) | (b[2] << 16) | ((u32)b[3] << 24);
+        return true;
+    };
+    auto readTag = [&](char* t) { return (bool)file.read(t, 4); };
+    file.seekg(0, std::ios::end);
+    u64 fileSize = (u64)file.tellg();
+    file.seekg(0);
+
+    char tag[4];
+    u32 riffSize = 0;
+    if (!readTag(tag) || std::memcmp(tag, "RIFF", 4) || !read32(riffSize) || !readTag(tag) || std::memcmp(tag, "sfbk", 4)) {
+        LogErr("Not a SoundFont 2 file.");
+        return false;
+    }
+
+    // pdta sub-chunks by name, smpl straight into the PCM buffer
+    std::vector<u8> phdr, pbag, pgen, inst, ibag, igen, shdr;
+    u64 riffEnd = 8 + (u64)riffSize;
+    while ((u64)file.tellg() + 12 <= riffEnd) {
+        u32 listSize = 0;
+        char listType[4];
+        if (!readTag(tag) || !read32(listSize)) break;
+        u64 listEnd = (u64)file.tellg() + listSize + (listSize & 1);
+        if (std::memcmp(tag, "LIST", 4) || !readTag(listType)) {
+            file.seekg(listEnd);
+            continue;
+        }
+
+        while ((u64)file.tellg() + 8 <= listEnd) {
+            u32 size = 0;
+            if (!readTag(tag) || !read32(size)) break;
+            u64 next = (u64)file.tellg() + size + (size & 1);
+            if (next > listEnd) break;
+            // Sizes come from the file, nothing gets allocated for bytes it does not have
+            if ((u64)file.tellg() + size > fileSize) {
+                LogErr("SF2 truncated.");
+                return false;
+            }
+
+            std::vector<u8>* dest = nullptr;
+            if (!std::memcmp(listType, "sdta", 4) && !std::memcmp(tag, "smpl", 4)) {
+                smpl.resize(size / 2);
+                file.read(reinterpret_cast<char*>(smpl.data()), smpl.size() * 2);
+            } else if (!std::memcmp(listType, "pdta", 4)) {
+                const struct { const char* name; std::vector<u8>* buf; } subs[] = {
+                    { "phdr", &phdr }, { "pbag", &pbag }, { "pgen", &pgen }, { "inst", &inst },
+                    { "ibag", &ibag }, { "igen", &igen }, { "shdr", &shdr },
+                };
+                for (const auto& s : subs) if (!std::memcmp(tag, s.name, 4)) dest = s.buf;
+            }
+            if (dest) {
+                dest->resize(size);
+                file.read(reinterpret_cast<char*>(dest->data()), size);
+            }
+            if (!file) {
+                LogErr("SF2 truncated.");
+                return false;
+            }
+            file.seekg(next);
+        }
+        file.seekg(listEnd);
+    }
+
+    if (smpl.empty() || phdr.size() < 38 * 2 || inst.size() < 22 * 2 || shdr.size() < 46 * 2) {
+        LogErr("SF2 is missing sample data or preset tables.");
+        return false;
+    }
+
+    // Samples
+    size_t nSamples = shdr.size() / 46 - 1;
+    sampleList.resize(nSamples);
+    for (size_t i = 0; i < nSamples; ++i) {
+        Reader r{ shdr, i * 46 };
+        Sf2Sample& s = sampleList[i];
+        s.name = r.name();
+        s.start = r.u32_();
+        s.end = r.u32_();
+        s.loop_start = r.u32_();
+        s.loop_end = r.u32_();
+        s.sample_rate = r.u32_();
+        s.root_key = r.u8_();
+        s.correction = (s8)r.u8_();
+        r.u16_(); // link
+        s.type = r.u16_();
+    }
+
+    auto readBags = [](const std::vector<u8>& raw) {
+        std::vector<u16> bags(raw.size() / 4);
+        for (size_t i = 0; i < bags.size(); ++i) bags[i] = raw[i * 4] | (raw[i * 4 + 1] << 8);
+        return bags;
+    };
+    std::vector<u16> pbags = readBags(pbag), ibags = readBags(ibag);
+
+    std::vector<InstHeader> insts(inst.size() / 22);
+    for (size_t i = 0; i < insts.size(); ++i) {
+        Reader r{ inst, i * 22 };
+        insts[i].name = r.name();
+        insts[i].bag = r.u16_();
+    }
+
+    size_t nPresets = phdr.size() / 38 - 1;
+    for (size_t p = 0; p < nPresets; ++p) {
+        Reader r{ phdr, p * 38 };
+        Sf2Preset preset;
+        preset.name = r.name();
+        preset.program = r.u16_();
+        preset.bank = r.u16_();
+        u16 bagFrom = r.u16_();
+        Reader rn{ phdr, (p + 1) * 38 + 24 };
+        u16 bagTo = rn.u16_();
+
+        Gens pGlobal;
+        std::vector<Gens> pZones;
+        split_zones(pbags, pgen, bagFrom, bagTo, GEN_INSTRUMENT, pGlobal, pZones);
+
+        for (Gens& pz : pZones) {
+            pz.under(pGlobal);
+            u16 ii = (u16)pz.v[GEN_INSTRUMENT];
+            if ((size_t)ii + 1 >= insts.size()) continue;
+
+            Gens iGlobal;
+            std::vector<Gens> iZones;
+            split_zones(ibags, igen, insts[ii].bag, insts[ii + 1].bag, GEN_SAMPLE_ID, iGlobal, iZones);
+
+            for (Gens& iz : iZones) {
+                iz.under(iGlobal);
+                u16 si = (u16)iz.v[GEN_SAMPLE_ID];
+                if (si >= sampleList.size() || (sampleList[si].type & SAMPLE_TYPE_ROM)) continue;
+
+                Sf2Zone z;
+                z.sample = si;
+                z.key_lo = std::max(iz.lo(GEN_KEY_RANGE), pz.lo(GEN_KEY_RANGE));
+                z.key_hi = std::min(iz.hi(GEN_KEY_RANGE), pz.hi(GEN_KEY_RANGE));
+                z.vel_lo = std::max(iz.lo(GEN_VEL_RANGE), pz.lo(GEN_VEL_RANGE));
+                z.vel_hi = std::min(iz.hi(GEN_VEL_RANGE), pz.hi(GEN_VEL_RANGE));
+                if (z.key_lo > z.key_hi || z.vel_lo > z.vel_hi) continue;
+
+                // Preset level values are offsets on the instrument's
+                z.root_key = iz.get(GEN_OVERRIDING_ROOT_KEY, -1);
+                z.coarse_tune = clamp_add(iz.get(GEN_COARSE_TUNE, 0), pz.get(GEN_COARSE_TUNE, 0), -120, 120);
+                z.fine_tune = clamp_add(iz.get(GEN_FINE_TUNE, 0), pz.get(GEN_FINE_TUNE, 0), -99, 99);
+                z.pan = clamp_add(iz.get(GEN_PAN, 0), pz.get(GEN_PAN, 0), -500, 500);
+                z.attack_tc = clamp_add(iz.get(GEN_ATTACK_VOL_ENV, -12000), pz.get(GEN_ATTACK_VOL_ENV, 0), -12000, 8000);
+                z.decay_tc = clamp_add(iz.get(GEN_DECAY_VOL_ENV, -12000), pz.get(GEN_DECAY_VOL_ENV, 0), -12000, 8000);
+                z.sustain_cb = (u16)clamp_add(iz.get(GEN_SUSTAIN_VOL_ENV, 0), pz.get(GEN_SUSTAIN_VOL_ENV, 0), 0, 1440);
+                z.release_tc = clamp_add(iz.get(GEN_RELEASE_VOL_ENV, -12000), pz.get(GEN_RELEASE_VOL_ENV, 0), -12000, 8000);
+                z.attenuation_cb = (u16)clamp_add(iz.get(GEN_INITIAL_ATTENUATION, 0), pz.get(GEN_INITIAL_ATTENUATION, 0), 0, 1440);
+                z.looping = (iz.get(GEN_SAMPLE_MODES, 0) & 1) != 0;
+
+                // Address offsets only exist at instrument level
+                z.start_offset = iz.get(GEN_START_ADDRS_OFFSET, 0) + iz.get(GEN_START_ADDRS_COARSE_OFFSET, 0) * 32768;
+                z.end_offset = iz.get(GEN_END_ADDRS_OFFSET, 0) + iz.get(GEN_END_ADDRS_COARSE_OFFSET, 0) * 32768;
+                z.loop_start_offset = iz.get(GEN_STARTLOOP_ADDRS_OFFSET, 0) + iz.get(GEN_STARTLOOP_ADDRS_COARSE_OFFSET, 0) * 32768;
+                z.loop_end_offset = iz.get(GEN_ENDLOOP_ADDRS_OFFSET, 0) + iz.get(GEN_ENDLOOP_ADDRS_COARSE_OFFSET, 0) * 32768;
+
+                preset.zones.push_back(z);
+            }
+        }
+        presetList.push_back(std::move(preset));
+    }
+
+    LogInfo("Loaded SF2: " + std::to_string(presetList.size()) + " presets, " + std::to_string(sampleList.size())
+            + " samples, " + std::to_string(smpl.size()) + " frames");
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef SF2READER_H
+#define SF2READER_H
+
+#include "main.h"
+#include <QString>
+#include <string>
+#include <vector>
+
+struct Sf2Sample {
+    std::string name;
+    u32 start, end;            // frames into the smpl data, end exclusive
+    u32 loop_start, loop_end;
+    u32 sample_rate;
+    u8 root_key;
+    s8 correction;             // cents
+    u16 type;
+};
+
+// One playable zone with the preset and instrument levels already merged: instrument
+// global zone under the local one, preset generators added on top, ranges intersected
+struct Sf2Zone {
+    u32 sample;
+    u8 key_lo = 0, key_hi = 127;
+    u8 vel_lo = 0, vel_hi = 127;
+    s16 root_key = -1;         // overridingRootKey, -1 = the sample's own
+    s16 coarse_tune = 0;       // semitones
+    s16 fine_tune = 0;         // cents
+    s16 pan = 0;               // -500..500
+    s16 attack_tc = -12000;
+    s16 decay_tc = -12000;
+    u16 sustain_cb = 0;
+    s16 release_tc = -12000;
+    u16 attenuation_cb = 0;
+    bool looping = false;
+    // Sample address offsets (fine + coarse * 32768), in frames
+    s32 start_offset = 0, end_offset = 0;
+    s32 loop_start_offset = 0, loop_end_offset = 0;
+};
+
+struct Sf2Preset {
+    std::string name;
+    u16 bank;
+    u16 program;
+    std::vector<Sf2Zone> zones;
+};
+
+// SoundFont 2 reader for the parts an import needs: presets flattened to zones, sample
+// headers and the 16-bit sample data (24-bit sm24 is ignored).
+class Sf2Reader {
+public:
+    bool load(const QString& path);
+
+    const std::vector<Sf2Preset>& presets() const { return presetList; }
+    const std::vector<Sf2Sample>& samples() const { return sampleList; }
+    const s16* pcm() const { return smpl.data(); }
+    size_t pcm_size() const { return smpl.size(); }
+
+private:
+    std::vector<Sf2Preset> presetList;
+    std::vector<Sf2Sample> sampleList;
+    std::vector<s16> smpl;
+};
+
+#endif // SF2READER_H
@@ -0,0 +1,413 @@
+#include "sf2writer.h"
+#include "partfile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// SF2 2.01 generator operators we emit
+enum : u16 {
+    GEN_PAN = 17,
+    GEN_ATTACK_VOL_ENV = 34,
+    GEN_DECAY_VOL_ENV = 36,
+    GEN_SUSTAIN_VOL_ENV = 37,
+    GEN_RELEASE_VOL_ENV = 38,
+    GEN_INSTRUMENT = 41,
+    GEN_KEY_RANGE = 43,
+    GEN_FINE_TUNE = 52,
+    GEN_SAMPLE_ID = 53,
+    GEN_SAMPLE_MODES = 54,
+    GEN_OVERRIDING_ROOT_KEY = 58,
+};
+
+// Spec wants at least 46 zero samples after each sample for interpolators
+static const u32 SAMPLE_PAD = 46;
+// Decode granularity, 1024 blocks = 28672 samples = 56KB of PCM in flight
+static const size_t CHUNK_BLOCKS = 1024;
+
+namespace {
+// Little-endian byte buffer for the metadata chunks
+struct Buf {
+    std::vector<u8> b;
+    void put8(u8 v) { b.push_back(v); }
+    void put16(u16 v) { put8(v & 0xFF); put8(v >> 8); }
+    void put32(u32 v) { put16(v & 0xFFFF); put16(v >> 16); }
+    void tag(const char* t) { b.insert(b.end(), t, t + 4); }
+    // Fixed 20 byte name field, always zero terminated
+    void name(const std::string& s) {
+        char n[20] = {};
+        std::memcpy(n, s.data(), std::min<size_t>(s.size(), 19));
+        b.insert(b.end(), n, n + 20);
+    }
+    // Zero terminated, padded to even length
+    void zstr(const std::string& s) {
+        b.insert(b.end(), s.begin(), s.end());
+        put8(0);
+        if (b.size() & 1) put8(0);
+    }
+    void chunk(const char* t, const Buf& body) {
+        tag(t);
+        put32((u32)body.b.size());
+        b.insert(b.end(), body.b.begin(), body.b.end());
+        if (body.b.size() & 1) put8(0);
+    }
+};
+
+// Running hash of the smpl data as it streams out, a word at a time. Recorded in the
+// manifest so the next export reads PCM back only from the file this one wrote.
+struct StreamHash {
+    u64 h = 0x27D4EB2F165667C5ull;
+    u64 word = 0;
+    u32 fill = 0;
+    u64 total = 0;
+
+    void add(const void* data, size_t n) {
+        const u8* p = static_cast<const u8*>(data);
+        total += n;
+        for (; n > 0 && fill > 0; --n) byte(*p++);
+        for (; n >= 8; n -= 8, p += 8) {
+            std::memcpy(&word, p, 8);
+            mix();
+        }
+        for (; n > 0; --n) byte(*p++);
+    }
+    u64 value() const {
+        u64 v = h;
+        if (fill > 0) v = (v ^ word) * 0x9E3779B97F4A7C15ull;
+        v ^= total;
+        v ^= v >> 29;
+        v *= 0xC2B2AE3D27D4EB4Full;
+        return v ^ (v >> 32);
+    }
+
+private:
+    void byte(u8 b) {
+        word |= (u64)b << (8 * fill);
+        if (++fill == 8) mix();
+    }
+    void mix() {
+        h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+        h = (h << 31) | (h >> 33);
+        word = 0;
+        fill = 0;
+    }
+};
+}
+
+static void put32(std::ofstream& out, u32 v) {
+    u8 b[4] = { (u8)v, (u8)(v >> 8), (u8)(v >> 16), (u8)(v >> 24) };
+    out.write(reinterpret_cast<const char*>(b), 4);
+}
+
+static u8 root_of(u8 root_key) {
+    return root_key > 0 ? root_key : 60;
+}
+
+// Generators a zone gets: the fixed eight, plus its own root key and fine tune where the
+// tone disagrees with the sample header (another tone's, the sample is deduplicated)
+static u32 zone_gens(const ExportZone& z, const SampleStore::Entry& e) {
+    return 8 + (root_of(z.tone->root_key) != root_of(e.root_key)) + (z.tone->pitch_fine != e.pitch_fine);
+}
+
+struct SampleHeader {
+    u32 start, end, loop_start, loop_end;
+};
+
+// The file previous describes, if it is still the one that was written
+// The previous output, if it is still the file the manifest describes. Size and layout
+// are checked first, then its smpl data is hashed: one read pass, far cheaper than the
+// decode it stands in for, and anything else that wrote the file is caught.
+static bool open_previous(std::ifstream& in, const std::string& path, const ExportManifest& previous) {
+    in.open(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open() || (u64)in.tellg() != previous.file_size || previous.smpl_offset < 8) return false;
+    char tag[4] = {};
+    u8 len[4] = {};
+    in.seekg(previous.smpl_offset - 8);
+    in.read(tag, 4);
+    in.read(reinterpret_cast<char*>(len), 4);
+    u64 smplBytes = len[0] | (len[1] << 8) | (len[2] << 16) | ((u64)len[3] << 24);
+    if (!in || std::memcmp(tag, "smpl", 4) != 0 || previous.smpl_offset + smplBytes > previous.file_size) return false;
+
+    StreamHash hash;
+    std::vector<char> buf(1 << 20);
+    for (u64 left = smplBytes; left > 0 && in;) {
+        size_t n = (size_t)std::min<u64>(left, buf.size());
+        in.read(buf.data(), n);
+        hash.add(buf.data(), n);
+        left -= n;
+    }
+    return in && hash.value() == previous.smpl_hash;
+}
+
+bool Sf2Writer::write(const std::string& path, const ExportPlan& plan, const std::string& bank_name,
+                      const ExportManifest* previous, ExportManifest* record, size_t* reused) {
+    const SampleStore& store = plan.samples();
+
+    // Bag/generator indices and sample ids are 16 bit in the file format. Checked before
+    // anything is opened, so an export that cannot fit leaves the old file alone.
+    u32 zoneCount = 0, zoneGens = 0;
+    for (const ExportProgram& ep : plan.programs()) {
+        zoneCount += (u32)ep.zones.size();
+        for (const ExportZone& z : ep.zones) zoneGens += zone_gens(z, store.entry(z.sample));
+    }
+    if (std::max({ (u32)plan.programs().size() * 2, zoneCount, zoneGens, (u32)store.size() }) > 0xFFFF) {
+        LogErr("SF2: too many zones or samples for one file");
+        return false;
+    }
+
+    std::ifstream old;
+    if (previous && !open_previous(old, path, *previous)) {
+        LogInfo("SF2: " + path + " changed since its manifest was written, decoding everything");
+        previous = nullptr;
+    }
+
+    // Written beside the target and renamed over it, a failed export leaves no half file
+    PartFile part{ path + ".part" };
+    const std::string& target = part.path;
+    std::ofstream out(target, std::ios::binary);
+    if (!out.is_open()) {
+        LogErr("SF2: could not open " + target);
+        return false;
+    }
+
+    // RIFF sfbk, sizes patched at the end
+    out.write("RIFF", 4);
+    put32(out, 0);
+    out.write("sfbk", 4);
+
+    Buf info;
+    {
+        Buf ifil, isng, inam, isft;
+        ifil.put16(2);
+        ifil.put16(1);
+        isng.zstr("EMU8000");
+        inam.zstr(bank_name);
+        isft.zstr("PS2snd");
+
+        Buf body;
+        body.tag("INFO");
+        body.chunk("ifil", ifil);
+        body.chunk("isng", isng);
+        body.chunk("INAM", inam);
+        body.chunk("ISFT", isft);
+        info.chunk("LIST", body);
+    }
+    out.write(reinterpret_cast<const char*>(info.b.data()), info.b.size());
+
+    // LIST sdta / smpl, streamed
+    std::streampos sdtaSizeAt = out.tellp() + std::streamoff(4);
+    out.write("LIST", 4);
+    put32(out, 0);
+    out.write("sdta", 4);
+    std::streampos smplSizeAt = out.tellp() + std::streamoff(4);
+    out.write("smpl", 4);
+    put32(out, 0);
+
+    std::vector<SampleHeader> headers(store.size());
+    std::vector<s16> chunk(CHUNK_BLOCKS * 28);
+    const std::vector<s16> pad(SAMPLE_PAD, 0);
+    u32 pos = 0; // in samples
+    u64 smplOffset = (u64)out.tellp();
+    size_t copied = 0;
+    StreamHash smplHash;
+
+    for (u32 i = 0; i < store.size(); ++i) {
+        const SampleStore::Entry& e = store.entry(i);
+        AdpcmDecoder dec(e.bd->bytes(e.offset), e.size, e.sample_rate);
+        const DecodedSample& lay = dec.info();
+        u32 total = (u32)dec.total_samples();
+
+        SampleHeader& h = headers[i];
+        h.start = pos;
+        h.end = pos + total;
+        // Non-empty loop inside the sample
+        u32 ls = lay.loop_start;
+        u32 le = lay.loop_end > ls ? lay.loop_end : total;
+        if (total > 0 && le >= total) le = total - 1;
+        h.loop_start = pos + ls;
+        h.loop_end = pos + le;
+
+        // Same content key decodes to the same PCM, take it from the last export if it is there
+        const ExportManifest::SamplePos* was = previous ? previous->sample(e.key) : nullptr;
+        if (was && was->frames == total) {
+            old.seekg(previous->smpl_offset + (u64)was->start * sizeof(s16));
+            for (u32 left = total; left > 0 && old;) {
+                u32 n = std::min<u32>(left, (u32)chunk.size());
+                old.read(reinterpret_cast<char*>(chunk.data()), n * sizeof(s16));
+                out.write(reinterpret_cast<const char*>(chunk.data()), n * sizeof(s16));
+                smplHash.add(chunk.data(), n * sizeof(s16));
+                left -= n;
+            }
+            if (!old) {
+                LogErr("SF2: could not read sample data back from " + path);
+                return false;
+            }
+            copied++;
+        } else {
+            while (!dec.finished()) {
+                size_t n = dec.decode(chunk.data(), CHUNK_BLOCKS);
+                out.write(reinterpret_cast<const char*>(chunk.data()), n * sizeof(s16));
+                smplHash.add(chunk.data(), n * sizeof(s16));
+            }
+        }
+        out.write(reinterpret_cast<const char*>(pad.data()), pad.size() * sizeof(s16));
+        smplHash.add(pad.data(), pad.size() * sizeof(s16));
+        if (record) record->add_sample(e.key, { h.start, total });
+        pos += total + SAMPLE_PAD;
+
+        if (!out) {
+            LogErr("SF2: write failed in sample data");
+            return false;
+        }
+    }
+
+    u32 smplBytes = pos * (u32)sizeof(s16);
+
+    // pdta, built in memory, it is only metadata
+    std::vector<const ExportProgram*> presets;
+    for (const auto& ep : plan.programs()) presets.push_back(&ep);
+    std::stable_sort(presets.begin(), presets.end(), [](const ExportProgram* a, const ExportProgram* b) {
+        return a->bank != b->bank ? a->bank < b->bank : a->program < b->program;
+    });
+
+    Buf phdr, pbag, pmod, pgen, inst, ibag, imod, igen, shdr;
+    u32 pbagNdx = 0, pgenNdx = 0, ibagNdx = 0, igenNdx = 0;
+
+    auto gen = [](Buf& b, u16 oper, u16 amount) {
+        b.put16(oper);
+        b.put16(amount);
+    };
+
+    for (size_t p = 0; p < presets.size(); ++p) {
+        const ExportProgram& ep = *presets[p];
+
+        // One instrument per program, one preset zone pointing at it
+        inst.name(ep.name);
+        inst.put16((u16)ibagNdx);
+        for (const ExportZone& z : ep.zones) {
+            ibag.put16((u16)igenNdx);
+            ibag.put16(0);
+            ibagNdx++;
+
+            // keyRange first, sampleID last, as the spec orders them
+            gen(igen, GEN_KEY_RANGE, (u16)(z.key_lo | (z.key_hi << 8)));
+            gen(igen, GEN_PAN, (u16)z.pan);
+            gen(igen, GEN_ATTACK_VOL_ENV, (u16)z.attack_tc);
+            gen(igen, GEN_DECAY_VOL_ENV, (u16)z.decay_tc);
+            gen(igen, GEN_SUSTAIN_VOL_ENV, z.sustain_cb);
+            gen(igen, GEN_RELEASE_VOL_ENV, (u16)z.release_tc);
+            gen(igen, GEN_SAMPLE_MODES, z.looping ? 1 : 0);
+            const SampleStore::Entry& e = store.entry(z.sample);
+            if (root_of(z.tone->root_key) != root_of(e.root_key)) gen(igen, GEN_OVERRIDING_ROOT_KEY, root_of(z.tone->root_key));
+            if (z.tone->pitch_fine != e.pitch_fine) gen(igen, GEN_FINE_TUNE, (u16)(s16)z.tone->pitch_fine);
+            gen(igen, GEN_SAMPLE_ID, (u16)z.sample);
+            igenNdx += zone_gens(z, e);
+        }
+
+        phdr.name("Preset " + std::to_string(ep.program));
+        phdr.put16(ep.program);
+        phdr.put16(ep.bank);
+        phdr.put16((u16)pbagNdx);
+        phdr.put32(0);
+        phdr.put32(0);
+        phdr.put32(0);
+
+        pbag.put16((u16)pgenNdx);
+        pbag.put16(0);
+        pbagNdx++;
+        gen(pgen, GEN_KEY_RANGE, (u16)(0 | (127 << 8)));
+        gen(pgen, GEN_INSTRUMENT, (u16)p);
+        pgenNdx += 2;
+    }
+
+    // Terminal records
+    phdr.name("EOP");
+    phdr.put16(0);
+    phdr.put16(0);
+    phdr.put16((u16)pbagNdx);
+    phdr.put32(0);
+    phdr.put32(0);
+    phdr.put32(0);
+    pbag.put16((u16)pgenNdx);
+    pbag.put16(0);
+    pmod.b.resize(10, 0);
+    gen(pgen, 0, 0);
+    inst.name("EOI");
+    inst.put16((u16)ibagNdx);
+    ibag.put16((u16)igenNdx);
+    ibag.put16(0);
+    imod.b.resize(10, 0);
+    gen(igen, 0, 0);
+
+    for (u32 i = 0; i < store.size(); ++i) {
+        const SampleStore::Entry& e = store.entry(i);
+        const SampleHeader& h = headers[i];
+        shdr.name("Smp_" + std::to_string(e.offset));
+        shdr.put32(h.start);
+        shdr.put32(h.end);
+        shdr.put32(h.loop_start);
+        shdr.put32(h.loop_end);
+        shdr.put32(e.sample_rate);
+        shdr.put8(root_of(e.root_key));
+        shdr.put8((u8)e.pitch_fine);
+        shdr.put16(0);
+        shdr.put16(1); // monoSample
+    }
+    shdr.name("EOS");
+    for (int i = 0; i < 26; ++i) shdr.put8(0);
+
+    Buf pdta, body;
+    body.tag("pdta");
+    body.chunk("phdr", phdr);
+    body.chunk("pbag", pbag);
+    body.chunk("pmod", pmod);
+    body.chunk("pgen", pgen);
+    body.chunk("inst", inst);
+    body.chunk("ibag", ibag);
+    body.chunk("imod", imod);
+    body.chunk("igen", igen);
+    body.chunk("shdr", shdr);
+    pdta.chunk("LIST", body);
+    out.write(reinterpret_cast<const char*>(pdta.b.data()), pdta.b.size());
+
+    // Patch sizes
+    u32 fileSize = (u32)out.tellp();
+    out.seekp(4);
+    put32(out, fileSize - 8);
+    out.seekp(sdtaSizeAt);
+    put32(out, 4 + 8 + smplBytes);
+    out.seekp(smplSizeAt);
+    put32(out, smplBytes);
+
+    out.close();
+    if (!out) {
+        LogErr("SF2: write failed");
+        return false;
+    }
+    // Straight over the old file, there is never a moment without one
+    old.close();
+    std::error_code ec;
+    std::filesystem::rename(target, path, ec);
+    if (ec) {
+        LogErr("SF2: could not replace " + path + " with " + target);
+        return false;
+    }
+    part.done = true;
+
+    if (record) {
+        record->file_size = fileSize;
+        record->smpl_offset = smplOffset;
+        record->smpl_hash = smplHash.value();
+        for (const ExportProgram& ep : plan.programs()) {
+            std::vector<ZoneEnvelope> zones;
+            zones.reserve(ep.zones.size());
+            for (const ExportZone& z : ep.zones) zones.push_back({ z.attack_tc, z.decay_tc, z.release_tc, z.sustain_cb });
+            record->add_program(ep.hash, std::move(zones));
+        }
+    }
+    if (reused) *reused = copied;
+
+    LogInfo("SF2: wrote " + std::to_string(fileSize) + " bytes, " + std::to_string(store.size()) + " samples"
+            + (previous ? ", " + std::to_string(copied) + " copied from the previous export" : ""));
+    return true;
+}
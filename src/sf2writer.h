@@ -0,0 +1,22 @@
+#ifndef SF2WRITER_H
+#define SF2WRITER_H
+
+#include "main.h"
+#include "exportplan.h"
+#include "exportmanifest.h"
+#include <string>
+
+// SoundFont 2 writer over an ExportPlan that never holds more than a chunk of PCM.
+// Samples are decoded straight into the smpl sub-chunk in store order, the pdta
+// metadata follows, and the RIFF/LIST sizes are patched once everything is out.
+class Sf2Writer {
+public:
+    // The file is written beside path and renamed over it once complete. previous:
+    // manifest of the file at path, samples it lists are copied from that file instead
+    // of decoded.
+    // record: gets this file's manifest. reused: how many samples were copied.
+    static bool write(const std::string& path, const ExportPlan& plan, const std::string& bank_name = "PS2snd Export",
+                      const ExportManifest* previous = nullptr, ExportManifest* record = nullptr, size_t* reused = nullptr);
+};
+
+#endif // SF2WRITER_H
@@ -0,0 +1,106 @@
+#include "sfzexport.h"
+#include "wav.h"
+#include "workerpool.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+static std::string sample_file(u32 i, const SampleStore::Entry& e) {
+    char name[64];
+    std::snprintf(name, sizeof(name), "samples/smp%04u_%08x.wav", i, e.offset);
+    return name;
+}
+
+// Timecents -> seconds, -32768 is the "instant" marker
+static double tc_seconds(s16 tc) {
+    return tc <= -12000 ? 0.0 : std::pow(2.0, tc / 1200.0);
+}
+
+bool SfzExporter::exportBanks(const QString& dir, const std::vector<ExportBank>& banks, ExportStats* stats) {
+    ExportPlan plan;
+    if (!plan.build(banks)) return false;
+    const SampleStore& store = plan.samples();
+
+    fs::path root(dir.toStdString());
+    std::error_code ec;
+    fs::create_directories(root / "samples", ec);
+    if (ec) {
+        LogErr("SFZ: could not create " + (root / "samples").string());
+        return false;
+    }
+
+    // Every distinct sample once, in parallel. Each task decodes and writes in chunks.
+    std::atomic<bool> failed{false};
+    {
+        WorkerPool pool;
+        for (u32 i = 0; i < store.size(); ++i) {
+            pool.submit([&, i] {
+                const SampleStore::Entry& e = store.entry(i);
+                std::string path = (root / sample_file(i, e)).string();
+                if (!WavWriter::write(path, e.bd->bytes(e.offset), e.size, e.sample_rate, e.root_key))
+                    failed = true;
+            });
+        }
+        pool.wait_idle();
+    }
+    if (failed) return false;
+
+    for (const ExportProgram& ep : plan.programs()) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "b%03u_p%03u.sfz", ep.bank, ep.program);
+        std::ofstream out(root / name);
+        if (!out.is_open()) {
+            LogErr(std::string("SFZ: could not open ") + name);
+            return false;
+        }
+
+        out << "// " << (ep.name.empty() ? "Program " + std::to_string(ep.program) : ep.name)
+            << " (bank " << ep.bank << ", program " << ep.program << ")\n";
+
+        for (const ExportZone& z : ep.zones) {
+            const SampleStore::Entry& e = store.entry(z.sample);
+
+            out << "\n<region>\n";
+            out << "sample=" << sample_file(z.sample, e) << "\n";
+            out << "lokey=" << (int)z.key_lo << " hikey=" << (int)z.key_hi
+                << " pitch_keycenter=" << (z.tone->root_key > 0 ? (int)z.tone->root_key : 60) << "\n";
+            // Tuned per region, tones sharing a deduplicated sample may not agree on it
+            if (z.tone->pitch_fine) out << "tune=" << (int)z.tone->pitch_fine << "\n";
+            out << "pan=" << z.pan / 5.0 << "\n";
+
+            if (z.looping) {
+                // Same clamping as the SF2 sample headers, end is inclusive in SFZ
+                AdpcmDecoder scan(e.bd->bytes(e.offset), e.size, e.sample_rate);
+                const DecodedSample& lay = scan.info();
+                u32 total = (u32)scan.total_samples();
+                u32 ls = lay.loop_start;
+                u32 le = lay.loop_end > ls ? lay.loop_end : total;
+                if (total > 0 && le >= total) le = total;
+                out << "loop_mode=loop_continuous loop_start=" << ls
+                    << " loop_end=" << (le > 0 ? le - 1 : 0) << "\n";
+            } else {
+                out << "loop_mode=no_loop\n";
+            }
+
+            // Sustain comes over as attenuation in centibels, SFZ wants a percentage
+            double sustain = 100.0 * std::pow(10.0, -z.sustain_cb / 200.0);
+            out << "ampeg_attack=" << tc_seconds(z.attack_tc)
+                << " ampeg_decay=" << tc_seconds(z.decay_tc)
+                << " ampeg_sustain=" << sustain
+                << " ampeg_release=" << tc_seconds(z.release_tc) << "\n";
+        }
+
+        if (!out) {
+            LogErr(std::string("SFZ: write failed for ") + name);
+            return false;
+        }
+    }
+
+    plan.fill_stats(stats);
+    LogInfo("SFZ: " + std::to_string(plan.programs().size()) + " programs, " + std::to_string(store.size()) + " samples");
+    return true;
+}
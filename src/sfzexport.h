@@ -0,0 +1,16 @@
+#ifndef SFZEXPORT_H
+#define SFZEXPORT_H
+
+#include "main.h"
+#include "exportplan.h"
+#include <QString>
+#include <vector>
+
+// One .sfz per program plus a shared samples/ folder of WAVs, each distinct sample
+// written once. Regions carry the same key ranges, pan, loop and envelope as the SF2 path.
+class SfzExporter {
+public:
+    static bool exportBanks(const QString& dir, const std::vector<ExportBank>& banks, ExportStats* stats = nullptr);
+};
+
+#endif // SFZEXPORT_H
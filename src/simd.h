@@ -0,0 +1,12 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is baseline on x86-64, everything else gets the scalar paths.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PS2SND_SSE2 1
+#include <emmintrin.h>
+#else
+#define PS2SND_SSE2 0
+#endif
+
+#endif // SIMD_H
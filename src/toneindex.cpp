@@ -0,0 +1,175 @@
+#include "toneindex.h"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <sstream>
+
+static const std::vector<u32> EMPTY;
+
+void ToneIndex::clear() {
+    refs.clear();
+    indexed.clear();
+    first_id.clear();
+    index.clear();
+}
+
+void ToneIndex::add_bank(u32 bank_no, const Bank& bank, const std::unordered_map<u32, SampleSpan>& samples) {
+    first_id[bank_no] = (u32)refs.size();
+    for (const auto& prog : bank.programs) {
+        for (u32 t = 0; t < prog->tones.size(); ++t) {
+            const Tone& tone = prog->tones[t];
+            u32 id = (u32)refs.size();
+            refs.push_back({ bank_no, prog->id, t });
+            indexed.push_back(tone);
+
+            auto sp = samples.find(tone.bd_offset);
+            bool looping = sp != samples.end() && sp->second.looping;
+
+            post(BankNo, bank_no, id);
+            post(ProgramId, prog->id, id);
+            post(Offset, tone.bd_offset, id);
+            post(Looping, looping ? 1 : 0, id);
+            post_values(tone, id, true);
+        }
+    }
+}
+
+void ToneIndex::post_values(const Tone& tone, u32 id, bool add) {
+    auto put = [&](Field f, u32 value) {
+        auto it = index.find(term(f, value));
+        if (it == index.end()) {
+            if (add) index[term(f, value)].push_back(id);
+            return;
+        }
+        std::vector<u32>& list = it->second;
+        auto at = std::lower_bound(list.begin(), list.end(), id);
+        if (add && (at == list.end() || *at != id)) list.insert(at, id);
+        if (!add && at != list.end() && *at == id) list.erase(at);
+        if (list.empty()) index.erase(it);
+    };
+    put(RootKey, tone.root_key);
+    for (u32 n = tone.min_note; n <= tone.max_note && n < 128; ++n) put(Note, n);
+    put(Adsr1, tone.adsr1);
+    put(Adsr2, tone.adsr2);
+    put(Rate, tone.sample_rate);
+}
+
+void ToneIndex::update_bank(u32 bank_no, const Bank& bank) {
+    auto first = first_id.find(bank_no);
+    if (first == first_id.end()) return;
+    u32 id = first->second;
+    for (const auto& prog : bank.programs) {
+        for (const Tone& tone : prog->tones) {
+            if (id >= indexed.size() || refs[id].bank != bank_no) return;
+            Tone& was = indexed[id];
+            if (was.root_key != tone.root_key || was.min_note != tone.min_note || was.max_note != tone.max_note
+                || was.adsr1 != tone.adsr1 || was.adsr2 != tone.adsr2 || was.sample_rate != tone.sample_rate) {
+                post_values(was, id, false);
+                post_values(tone, id, true);
+                was = tone;
+            }
+            ++id;
+        }
+    }
+}
+
+const std::vector<u32>& ToneIndex::postings(Field f, u32 value) const {
+    auto it = index.find(term(f, value));
+    return it != index.end() ? it->second : EMPTY;
+}
+
+std::vector<u32> ToneIndex::any_of(Field f, const std::vector<u32>& values) const {
+    // One mark per tone beats merging list after list when a range spans many values
+    std::vector<char> hit(refs.size(), 0);
+    for (u32 v : values)
+        for (u32 id : postings(f, v)) hit[id] = 1;
+
+    std::vector<u32> out;
+    for (u32 id = 0; id < hit.size(); ++id)
+        if (hit[id]) out.push_back(id);
+    return out;
+}
+
+static bool parse_number(const std::string& s, u32& out) {
+    if (s.empty()) return false;
+    try {
+        size_t used = 0;
+        unsigned long v = std::stoul(s, &used, 0);
+        if (used != s.size()) return false;
+        out = (u32)v;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool ToneIndex::query(const std::string& text, std::vector<u32>& out) const {
+    // Each term becomes one sorted id list, the answer is their intersection
+    std::vector<std::vector<u32>> lists;
+
+    std::istringstream in(text);
+    std::string tok;
+    while (in >> tok) {
+        std::transform(tok.begin(), tok.end(), tok.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+        size_t colon = tok.find(':');
+        std::string name = colon == std::string::npos ? "" : tok.substr(0, colon);
+        std::string value = colon == std::string::npos ? tok : tok.substr(colon + 1);
+        u32 v = 0;
+
+        if (name.empty()) {
+            if (!parse_number(value, v)) return false;
+            std::vector<u32> a = postings(Offset, v), merged;
+            const auto& b = postings(ProgramId, v);
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(merged));
+            lists.push_back(std::move(merged));
+        } else if (name == "key") {
+            size_t dash = value.find('-');
+            u32 lo = 0, hi = 0;
+            if (dash == std::string::npos) {
+                if (!parse_number(value, lo)) return false;
+                hi = lo;
+            } else if (!parse_number(value.substr(0, dash), lo) || !parse_number(value.substr(dash + 1), hi)) {
+                return false;
+            }
+            if (lo == hi) {
+                lists.push_back(postings(Note, lo));
+            } else {
+                std::vector<u32> notes;
+                for (u32 n = lo; n <= std::min<u32>(hi, 127); ++n) notes.push_back(n);
+                lists.push_back(any_of(Note, notes));
+            }
+        } else if (name == "loop") {
+            if (value == "yes" || value == "1" || value == "true") v = 1;
+            else if (value == "no" || value == "0" || value == "false") v = 0;
+            else return false;
+            lists.push_back(postings(Looping, v));
+        } else {
+            static const struct { const char* name; Field field; } fields[] = {
+                { "bank", BankNo }, { "prog", ProgramId }, { "offset", Offset }, { "root", RootKey },
+                { "adsr1", Adsr1 }, { "adsr2", Adsr2 }, { "rate", Rate },
+            };
+            const Field* f = nullptr;
+            for (const auto& e : fields) if (name == e.name) f = &e.field;
+            if (!f || !parse_number(value, v)) return false;
+            lists.push_back(postings(*f, v));
+        }
+    }
+
+    out.clear();
+    if (lists.empty()) {
+        out.resize(refs.size());
+        for (u32 i = 0; i < out.size(); ++i) out[i] = i;
+        return true;
+    }
+
+    // Smallest first keeps every intermediate result as short as possible
+    std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+    out = lists[0];
+    for (size_t i = 1; i < lists.size() && !out.empty(); ++i) {
+        std::vector<u32> next;
+        std::set_intersection(out.begin(), out.end(), lists[i].begin(), lists[i].end(), std::back_inserter(next));
+        out.swap(next);
+    }
+    return true;
+}
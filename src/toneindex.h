@@ -0,0 +1,56 @@
+#ifndef TONEINDEX_H
+#define TONEINDEX_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Inverted index over tone attributes across every loaded bank. Tone ids are handed
+// out in load order, so every posting list is sorted and a query is a chain of merges.
+class ToneIndex {
+public:
+    enum Field : u8 { BankNo, ProgramId, Offset, RootKey, Note, Adsr1, Adsr2, Rate, Looping, FieldCount };
+
+    struct ToneRef {
+        u32 bank;
+        u32 program; // Program::id
+        u32 tone;    // index into Program::tones
+    };
+
+    void clear();
+    // Ids continue from the previous bank, in program then tone order.
+    // samples holds the boundary scan for every offset the bank uses.
+    void add_bank(u32 bank_no, const Bank& bank, const std::unordered_map<u32, SampleSpan>& samples);
+    // The bank after an edit, undo or redo (same tones, same ids). Only tones whose
+    // values changed move between postings.
+    void update_bank(u32 bank_no, const Bank& bank);
+
+    size_t size() const { return refs.size(); }
+    const ToneRef& ref(u32 id) const { return refs[id]; }
+    const std::vector<u32>& postings(Field f, u32 value) const;
+
+    // Whitespace separated terms, all of which must match:
+    //   bank:N prog:N offset:N root:N key:N key:LO-HI adsr1:N adsr2:N rate:N loop:yes|no
+    // key matches tones whose range covers the note (or overlaps LO-HI). A bare number
+    // matches an offset or a program id. Numbers take 0x for hex. Empty text matches all.
+    // Returns false on a term it cannot parse.
+    bool query(const std::string& text, std::vector<u32>& out) const;
+
+private:
+    static u64 term(Field f, u32 value) { return ((u64)f << 32) | value; }
+    void post(Field f, u32 value, u32 id) { index[term(f, value)].push_back(id); }
+    // Postings of the editable fields, kept sorted
+    void post_values(const Tone& tone, u32 id, bool add);
+    // Sorted union of the postings for each value
+    std::vector<u32> any_of(Field f, const std::vector<u32>& values) const;
+
+    std::vector<ToneRef> refs;
+    std::vector<Tone> indexed; // by id, as last posted
+    std::unordered_map<u32, u32> first_id; // by bank
+    std::unordered_map<u64, std::vector<u32>> index;
+};
+
+#endif // TONEINDEX_H
@@ -1,22 +1,69 @@
 #include "ps2snd.h"
 #include "ui_ps2snd.h"
 #include "2sf2.h"
+#include "sfzexport.h"
+#include "dlswriter.h"
+#include "hdwriter.h"
+#include "sf2import.h"
+#include "vag.h"
+#include "wavextract.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QFileInfo>
+#include <QScreen>
+#include <QElapsedTimer>
+#include <QInputDialog>
 #include <algorithm>
 #include <cstring>
+#include <cmath>
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow) {
     ui->setupUi(this);
 
     waveformWidget = new WaveformWidget(this);
     ui->waveformLayout->addWidget(waveformWidget);
-
-    ui->treeWidget->setHeaderLabels({"Item", "Type", "Info"});
+    spectrogramWidget = new SpectrogramWidget(this);
+    spectrogramWidget->setVisible(false);
+    ui->waveformLayout->addWidget(spectrogramWidget);
+    connect(waveformWidget, &WaveformWidget::viewChanged, spectrogramWidget, &SpectrogramWidget::setView);
+    connect(ui->chkSpectrogram, &QCheckBox::toggled, spectrogramWidget, &QWidget::setVisible);
+    waveScroll = new QScrollBar(Qt::Horizontal, this);
+    ui->waveformLayout->addWidget(waveScroll);
+    connect(waveformWidget, &WaveformWidget::viewChanged, this, &MainWindow::onWaveformViewChanged);
+    connect(waveScroll, &QScrollBar::valueChanged, this, [this](int v) { waveformWidget->setViewStart(v); });
+    connect(waveformWidget, &WaveformWidget::loopChanged, this, &MainWindow::onLoopEdited);
+    connect(ui->propTable, &QTableWidget::itemChanged, this, &MainWindow::onPropertyEdited);
+
+    ui->treeWidget->setHeaderLabels({"Item", "Type", "Info", "Shape"});
     ui->treeWidget->setColumnWidth(0, 250);
     ui->treeWidget->setColumnWidth(1, 100);
+    ui->treeWidget->setColumnWidth(3, ThumbnailDelegate::THUMB_W + 8);
+    ui->treeWidget->setUniformRowHeights(true); // keeps scrolling cheap with thousands of rows
+    thumbDelegate = new ThumbnailDelegate(ui->treeWidget, &decodeQueue);
+    ui->treeWidget->setItemDelegateForColumn(3, thumbDelegate);
+
+    for (int p = SpuReverb::Off; p < SpuReverb::PresetCount; ++p)
+        ui->cmbReverb->addItem(SpuReverb::preset_name(p));
+    ui->cmbReverb->setCurrentIndex(SpuReverb::Hall);
+
+    statsLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(statsLabel);
+    statsTimer = new QTimer(this);
+    connect(statsTimer, &QTimer::timeout, this, &MainWindow::refreshAudioStats);
+    statsTimer->start(250);
+    refreshAudioStats();
+
+    streamTimer = new QTimer(this);
+    streamTimer->setInterval(33);
+    connect(streamTimer, &QTimer::timeout, this, &MainWindow::pollStream);
+
+    // Cursor follows the display refresh, not the audio period
+    cursorTimer = new QTimer(this);
+    qreal hz = screen() ? screen()->refreshRate() : 60.0;
+    cursorTimer->setInterval(std::max(4, (int)(1000.0 / (hz > 0 ? hz : 60.0))));
+    cursorTimer->setTimerType(Qt::PreciseTimer);
+    connect(cursorTimer, &QTimer::timeout, this, &MainWindow::pollCursor);
 
     // just in case
     connect(ui->treeWidget, &QTreeWidget::itemSelectionChanged, this, &MainWindow::on_treeWidget_itemSelectionChanged);
@@ -25,6 +72,7 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
 
 MainWindow::~MainWindow() {
     if (deviceInit) ma_device_uninit(&device);
+    stream.close();
     delete ui;
 }
 
@@ -32,42 +80,153 @@ void MainWindow::clearProperties() {
     ui->propTable->setRowCount(0);
 }
 
-void MainWindow::addProperty(const QString& key, const QString& value) {
+void MainWindow::setPropertyValue(const QString& key, const QString& value) {
+    for (int r = 0; r < ui->propTable->rowCount(); ++r) {
+        if (ui->propTable->item(r, 0) && ui->propTable->item(r, 0)->text() == key) {
+            QSignalBlocker block(ui->propTable);
+            ui->propTable->item(r, 1)->setText(value);
+            return;
+        }
+    }
+    addProperty(key, value);
+}
+
+// Editable values go back into the bank through onPropertyEdited
+void MainWindow::addProperty(const QString& key, const QString& value, bool editable) {
+    QSignalBlocker block(ui->propTable);
     int r = ui->propTable->rowCount();
     ui->propTable->insertRow(r);
-    ui->propTable->setItem(r, 0, new QTableWidgetItem(key));
-    ui->propTable->setItem(r, 1, new QTableWidgetItem(value));
+    auto* keyItem = new QTableWidgetItem(key);
+    keyItem->setFlags(keyItem->flags() & ~Qt::ItemIsEditable);
+    auto* valueItem = new QTableWidgetItem(value);
+    if (!editable) valueItem->setFlags(valueItem->flags() & ~Qt::ItemIsEditable);
+    ui->propTable->setItem(r, 0, keyItem);
+    ui->propTable->setItem(r, 1, valueItem);
+}
+
+// Tone fields the property table can edit, false on a malformed or out of range value
+static bool parseToneProperty(const QString& key, const QString& text, Tone& t) {
+    bool ok = false;
+    if (key == "Key Range") {
+        QStringList parts = text.split('-');
+        bool okLo = false, okHi = false;
+        uint lo = parts.size() == 2 ? parts[0].trimmed().toUInt(&okLo) : 0;
+        uint hi = parts.size() == 2 ? parts[1].trimmed().toUInt(&okHi) : 0;
+        if (!okLo || !okHi || lo > hi || hi > 127) return false;
+        t.min_note = (u8)lo;
+        t.max_note = (u8)hi;
+        return true;
+    }
+    if (key == "ADSR 1 (Raw)" || key == "ADSR 2 (Raw)") {
+        uint v = text.toUInt(&ok, 0);
+        if (!ok || v > 0xFFFF) return false;
+        (key == "ADSR 1 (Raw)" ? t.adsr1 : t.adsr2) = (u16)v;
+        return true;
+    }
+    if (key == "Pitch Fine") {
+        int v = text.toInt(&ok);
+        if (!ok || v < -128 || v > 127) return false;
+        t.pitch_fine = (s8)v;
+        return true;
+    }
+    uint v = text.toUInt(&ok);
+    if (!ok || v > 127) return false;
+    if (key == "Root Key") t.root_key = (u8)v;
+    else if (key == "Volume") t.volume = (u8)v;
+    else if (key == "Pan") t.pan = (u8)v;
+    else return false;
+    return true;
+}
+
+void MainWindow::onPropertyEdited(QTableWidgetItem* item) {
+    if (item->column() != 1 || !ui->propTable->item(item->row(), 0)) return;
+    auto items = ui->treeWidget->selectedItems();
+    if (items.empty()) return;
+
+    u32 progId = (u32)items[0]->data(0, Qt::UserRole).toInt();
+    int toneIdx = items[0]->data(0, Qt::UserRole + 1).toInt();
+    u32 bankNo = items[0]->data(0, Qt::UserRole + 2).toUInt();
+    QString key = ui->propTable->item(item->row(), 0)->text();
+    QString text = item->text().trimmed();
+
+    bool ok = false;
+    if (toneIdx == -1) {
+        auto prog = workspace.program(bankNo, progId);
+        uint v = text.toUInt(&ok);
+        ok = ok && prog && v <= 127;
+        if (ok) {
+            u8 vol = key == "Master Volume" ? (u8)v : prog->master_vol;
+            u8 pan = key == "Master Pan" ? (u8)v : prog->master_pan;
+            ok = workspace.edit_program(bankNo, progId, vol, pan);
+        }
+    } else if (const Tone* cur = workspace.tone(bankNo, progId, toneIdx)) {
+        Tone t = *cur;
+        ok = parseToneProperty(key, text, t) && workspace.edit_tone(bankNo, progId, toneIdx, t);
+    }
+    if (!ok) ui->statusbar->showMessage("Invalid value for " + key + ".");
+
+    // Not from inside the table's own signal, the refresh rebuilds the rows
+    QTimer::singleShot(0, this, [this, bankNo] { refreshBank((int)bankNo); });
+}
+
+void MainWindow::on_actionUndo_triggered() {
+    int bankNo = selectedBankNo();
+    if (bankNo < 0) return;
+    if (workspace.undo(bankNo)) refreshBank(bankNo);
+    else ui->statusbar->showMessage("Nothing to undo.");
+}
+
+void MainWindow::on_actionRedo_triggered() {
+    int bankNo = selectedBankNo();
+    if (bankNo < 0) return;
+    if (workspace.redo(bankNo)) refreshBank(bankNo);
+    else ui->statusbar->showMessage("Nothing to redo.");
 }
 
 void MainWindow::data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+    auto t0 = AudioStats::Clock::now();
     MainWindow* self = (MainWindow*)pDevice->pUserData;
-    if (!self || !self->isPlaying || self->playBuffer.empty()) {
+    if (!self) {
         memset(pOutput, 0, frameCount * sizeof(s16));
         return;
     }
-    s16* out = (s16*)pOutput;
-    size_t samplesToWrite = frameCount;
-    size_t totalWritten = 0;
-    while (samplesToWrite > 0) {
-        size_t available = self->playBuffer.size() - self->playCursor;
-        if (available == 0) {
-            if (self->loopPlayback) {
-                self->playCursor = (self->currentSample.looping && self->currentSample.loop_end > self->currentSample.loop_start)
-                ? self->currentSample.loop_start : 0;
-                if (self->playBuffer.empty()) break;
-                continue;
-            } else break;
-        }
-        size_t toCopy = std::min(samplesToWrite, available);
-        memcpy(out + totalWritten, self->playBuffer.data() + self->playCursor, toCopy * sizeof(s16));
-        self->playCursor += toCopy;
-        totalWritten += toCopy;
-        samplesToWrite -= toCopy;
+    if (!self->isPlaying || !self->stream.is_open()) {
+        memset(pOutput, 0, frameCount * sizeof(s16));
+        // Idle, nothing to time. The gap until playback resumes is not an xrun either.
+        self->audioStats.mark_stopped();
+        return;
     }
-    if (totalWritten < frameCount) {
-        memset(out + totalWritten, 0, (frameCount - totalWritten) * sizeof(s16));
-        if (!self->loopPlayback) self->isPlaying = false;
+    s16* out = (s16*)pOutput;
+    size_t got = self->stream.read(out, frameCount);
+    u32 silence = frameCount - (u32)got;
+    bool underrun = false;
+    if (silence) {
+        memset(out + got, 0, silence * sizeof(s16));
+        // short read before the end means the decoder/feeder fell behind
+        if (self->stream.exhausted()) self->isPlaying = false;
+        else underrun = true;
     }
+    if (self->currentReverb) self->reverb.process(out, frameCount);
+
+    self->audioStats.record(t0, frameCount, silence, underrun);
+}
+
+void MainWindow::refreshAudioStats() {
+    AudioStats::Snapshot s = audioStats.snapshot();
+    statsLabel->setText(QString("Load %1% (peak %2%) | xruns %3 | overruns %4 | underruns %5 | silence %6")
+                        .arg(s.last_load / 10.0, 0, 'f', 1)
+                        .arg(s.peak_load / 10.0, 0, 'f', 1)
+                        .arg(s.xruns)
+                        .arg(s.overruns)
+                        .arg(s.underruns)
+                        .arg(s.silence_frames));
+}
+
+void MainWindow::on_actionDumpAudioStats_triggered() {
+    QString path = QFileDialog::getSaveFileName(this, "Dump Audio Stats", "audio_stats.txt", "Text (*.txt)");
+    if (path.isEmpty()) return;
+    if (!audioStats.dump(path.toStdString()))
+        QMessageBox::critical(this, "Error", "Failed to write audio stats.");
 }
 
 void MainWindow::on_actionOpen_HD_triggered() {
@@ -83,26 +242,169 @@ void MainWindow::on_actionOpen_HD_triggered() {
         if (bdPath.isEmpty()) return;
     }
 
-    if (!bdParser.load(bdPath)) {
-        QMessageBox::critical(this, "Error", "Failed to load BD file.");
+    openBank(hdPath, bdPath);
+}
+
+bool MainWindow::openBank(const QString& hdPath, const QString& bdPath) {
+    int bankNo = workspace.add(hdPath, bdPath);
+    if (bankNo < 0) {
+        QMessageBox::critical(this, "Error", "Failed to load HD/BD pair.");
+        return false;
+    }
+    showNewBank(bankNo);
+    return true;
+}
+
+void MainWindow::on_actionCarveBD_triggered() {
+    QString bdPath = QFileDialog::getOpenFileName(this, "Recover Samples from BD", "", "BD Files (*.bd);;All Files (*)");
+    if (bdPath.isEmpty()) return;
+    bool ok = false;
+    int rate = QInputDialog::getInt(this, "Recover Samples", "Sample rate to play them at (the HD would say):", 22050, 1000, 96000, 1, &ok);
+    if (!ok) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    int bankNo = workspace.add_carved(bdPath, (u32)rate);
+    QApplication::restoreOverrideCursor();
+    if (bankNo < 0) {
+        QMessageBox::critical(this, "Error", "No samples found in " + QFileInfo(bdPath).fileName() + ".");
+        return;
+    }
+    showNewBank(bankNo);
+}
+
+void MainWindow::on_actionOpenImage_triggered() {
+    QString path = QFileDialog::getOpenFileName(this, "Open Banks in Image", "", "Disc Images and Archives (*.iso *.bin *.img *.dat *.pak);;All Files (*)");
+    if (path.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QElapsedTimer timer;
+    timer.start();
+    int first = (int)workspace.size();
+    int added = workspace.add_image(path);
+    QApplication::restoreOverrideCursor();
+    if (added <= 0) {
+        QMessageBox::critical(this, "Error", "No HD/BD banks found in " + QFileInfo(path).fileName() + ".");
+        return;
+    }
+    for (int i = 0; i < added; ++i) showNewBank(first + i);
+    ui->statusbar->showMessage(QString("Found %1 banks in %2 (%3 s).").arg(added).arg(QFileInfo(path).fileName()).arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void MainWindow::on_actionOpenVAG_triggered() {
+    QStringList paths = QFileDialog::getOpenFileNames(this, "Open VAG Files", "", "VAG Files (*.vag *.VAG);;All Files (*)");
+    if (paths.isEmpty()) return;
+    int bankNo = workspace.add_vags(std::vector<QString>(paths.begin(), paths.end()));
+    if (bankNo < 0) {
+        QMessageBox::critical(this, "Error", "None of the files is a VAG.");
         return;
     }
-    if (!hdParser.load(hdPath, currentBank)) {
-        QMessageBox::critical(this, "Error", "Failed to load HD file.");
+    showNewBank(bankNo);
+}
+
+void MainWindow::on_actionDecodeVAG_triggered() {
+    QString inDir = QFileDialog::getExistingDirectory(this, "Folder with VAG Files");
+    if (inDir.isEmpty()) return;
+    QString outDir = QFileDialog::getExistingDirectory(this, "Write WAV Files To");
+    if (outDir.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QElapsedTimer timer;
+    timer.start();
+    VagBatchStats stats;
+    bool ok = VagReader::decode_all({ inDir }, outDir, &stats);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::critical(this, "Error", "Decoding failed, see the log.");
+        return;
+    }
+    ui->statusbar->showMessage(QString("Decoded %1 VAG files (%2 skipped) in %3 s.").arg(stats.decoded).arg(stats.skipped).arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void MainWindow::showNewBank(int bankNo) {
+    // Banks already open stay where they are, nothing reading them needs to stop
+    thumbDelegate->addSource(&workspace.bank(bankNo).bd);
+    addBankToTree(bankNo);
+    applyFilter(ui->editFilter->text());
+
+    ui->statusbar->showMessage(QString("Loaded %1 programs (%2 banks, %3 tones indexed, %4 distinct samples, %5 KB duplicate PCM).")
+        .arg(workspace.bank(bankNo).bank.programs.size()).arg(workspace.size()).arg(workspace.index().size())
+        .arg(workspace.distinct_samples()).arg(workspace.duplicate_bytes() / 1024));
+}
+
+void MainWindow::on_actionImportSF2_triggered() {
+    QString sf2Path = QFileDialog::getOpenFileName(this, "Import SF2", "", "SoundFont (*.sf2)");
+    if (sf2Path.isEmpty()) return;
+    QString hdPath = QFileDialog::getSaveFileName(this, "Save Imported Bank", QFileInfo(sf2Path).completeBaseName() + ".hd", "HD Files (*.hd *.HD)");
+    if (hdPath.isEmpty()) return;
+    QString bdPath = hdPath;
+    if (bdPath.endsWith(".hd", Qt::CaseInsensitive)) bdPath.replace(bdPath.length() - 3, 3, ".bd");
+    else bdPath += ".bd";
+    for (size_t i = 0; i < workspace.size(); ++i) {
+        const LoadedBank& lb = workspace.bank(i);
+        if (QFileInfo(hdPath) == QFileInfo(lb.hd_path) || QFileInfo(bdPath) == QFileInfo(lb.bd_path)) {
+            QMessageBox::critical(this, "Error", "That bank is open, choose a different name.");
+            return;
+        }
+    }
+
+    // Fast first, the exhaustive search is many times slower for a little less noise
+    bool accepted = false;
+    QString mode = QInputDialog::getItem(this, "Import SF2", "VAG encoder:", { "Fast", "Quality (slow)" }, 0, false, &accepted);
+    if (!accepted) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = Sf2Importer::import(sf2Path, hdPath, bdPath, mode == "Fast" ? VagEncoder::Fast : VagEncoder::Quality);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::critical(this, "Error", "Import failed, see the log.");
         return;
     }
+    if (openBank(hdPath, bdPath)) ui->statusbar->showMessage(QString("Imported %1 in %2 s.").arg(QFileInfo(sf2Path).fileName()).arg(timer.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void MainWindow::on_actionCloseAll_triggered() {
+    on_btnStop_clicked();
+    stream.close();
+    // Decode jobs (thumbnails' too) read straight from the BDs, they go first
+    decodeQueue.clear();
+    thumbDelegate->clearSources();
+    workspace.clear();
 
     ui->treeWidget->clear();
     clearProperties();
+    currentSample = {};
+    currentReverb = false;
     waveformWidget->clear();
+    spectrogramWidget->clear();
+}
 
-    for (const auto& prog : currentBank.programs) {
-        QTreeWidgetItem* pItem = new QTreeWidgetItem(ui->treeWidget);
+// Items carry UserRole = program id, +1 = tone index (-1 program, -2 bank), +2 = bank,
+// and tones +3 = their ToneIndex id
+void MainWindow::addBankToTree(int bankNo) {
+    const LoadedBank& lb = workspace.bank(bankNo);
+
+    // ToneIndex numbered this bank's tones last, in the same order we walk them
+    u32 toneId = (u32)workspace.index().size();
+    for (const auto& prog : lb.bank.programs) toneId -= (u32)prog->tones.size();
+
+    QTreeWidgetItem* bItem = new QTreeWidgetItem(ui->treeWidget);
+    bItem->setText(0, lb.name);
+    bItem->setText(1, "Bank");
+    bItem->setText(2, QString("%1 Programs").arg(lb.bank.programs.size()));
+    bItem->setData(0, Qt::UserRole, -1);
+    bItem->setData(0, Qt::UserRole + 1, -2);
+    bItem->setData(0, Qt::UserRole + 2, bankNo);
+
+    for (const auto& prog : lb.bank.programs) {
+        QTreeWidgetItem* pItem = new QTreeWidgetItem(bItem);
         pItem->setText(0, QString("Program %1").arg(prog->id));
         pItem->setText(1, "Instrument");
         pItem->setText(2, QString("%1 Tones").arg(prog->tones.size()));
         pItem->setData(0, Qt::UserRole, (int)prog->id);
         pItem->setData(0, Qt::UserRole + 1, -1);
+        pItem->setData(0, Qt::UserRole + 2, bankNo);
 
         int toneIdx = 0;
         for (const auto& tone : prog->tones) {
@@ -110,15 +412,89 @@ void MainWindow::on_actionOpen_HD_triggered() {
             tItem->setText(0, QString("Tone %1 (Key %2-%3)").arg(toneIdx).arg(tone.min_note).arg(tone.max_note));
             tItem->setText(1, "Sample");
             tItem->setText(2, QString("VAG: 0x%1").arg(tone.bd_offset, 0, 16));
+            tItem->setData(3, Qt::UserRole, (qulonglong)workspace.content_key(bankNo, tone.bd_offset));
+            tItem->setData(3, Qt::UserRole + 1, (qulonglong)Workspace::sample_key(bankNo, tone.bd_offset));
+            tItem->setData(3, Qt::UserRole + 2, tone.sample_rate);
 
             tItem->setData(0, Qt::UserRole, (int)prog->id);
             tItem->setData(0, Qt::UserRole + 1, toneIdx);
+            tItem->setData(0, Qt::UserRole + 2, bankNo);
+            tItem->setData(0, Qt::UserRole + 3, toneId++);
 
             toneIdx++;
         }
     }
+    bItem->setExpanded(true);
+}
+
+// Tree texts and properties after the bank changed version, tone ids are unchanged
+void MainWindow::refreshBank(int bankNo) {
+    if (bankNo < 0 || bankNo >= (int)workspace.size()) return;
+    for (int b = 0; b < ui->treeWidget->topLevelItemCount(); ++b) {
+        QTreeWidgetItem* bItem = ui->treeWidget->topLevelItem(b);
+        if (bItem->data(0, Qt::UserRole + 2).toInt() != bankNo) continue;
+        for (int p = 0; p < bItem->childCount(); ++p) {
+            QTreeWidgetItem* pItem = bItem->child(p);
+            for (int t = 0; t < pItem->childCount(); ++t) {
+                QTreeWidgetItem* tItem = pItem->child(t);
+                const Tone* tone = toneForItem(tItem);
+                if (tone) tItem->setText(0, QString("Tone %1 (Key %2-%3)").arg(t).arg(tone->min_note).arg(tone->max_note));
+            }
+        }
+    }
+    applyFilter(ui->editFilter->text());
+    on_treeWidget_itemSelectionChanged();
+}
+
+void MainWindow::on_editFilter_textChanged(const QString& text) {
+    applyFilter(text);
+}
+
+void MainWindow::applyFilter(const QString& text) {
+    QElapsedTimer timer;
+    timer.start();
+
+    std::vector<u32> hits;
+    if (!workspace.index().query(text.toStdString(), hits)) {
+        ui->editFilter->setStyleSheet("color: red;");
+        return;
+    }
+    ui->editFilter->setStyleSheet("");
+    double queryMs = timer.nsecsElapsed() / 1e6;
+
+    std::vector<char> match(workspace.index().size(), 0);
+    for (u32 id : hits) match[id] = 1;
+    bool filtering = !text.trimmed().isEmpty();
+
+    // Only touch items whose visibility actually changes, hiding is the slow part
+    ui->treeWidget->setUpdatesEnabled(false);
+    for (int b = 0; b < ui->treeWidget->topLevelItemCount(); ++b) {
+        QTreeWidgetItem* bItem = ui->treeWidget->topLevelItem(b);
+        bool bankHit = false;
+        for (int p = 0; p < bItem->childCount(); ++p) {
+            QTreeWidgetItem* pItem = bItem->child(p);
+            bool progHit = false;
+            for (int t = 0; t < pItem->childCount(); ++t) {
+                QTreeWidgetItem* tItem = pItem->child(t);
+                bool hit = match[tItem->data(0, Qt::UserRole + 3).toUInt()];
+                if (tItem->isHidden() == hit) tItem->setHidden(!hit);
+                progHit |= hit;
+            }
+            bool showProg = progHit || !filtering;
+            if (pItem->isHidden() == showProg) pItem->setHidden(!showProg);
+            if (filtering && progHit && !pItem->isExpanded()) pItem->setExpanded(true);
+            bankHit |= progHit;
+        }
+        bool showBank = bankHit || !filtering;
+        if (bItem->isHidden() == showBank) bItem->setHidden(!showBank);
+    }
+    ui->treeWidget->setUpdatesEnabled(true);
 
-    ui->statusbar->showMessage(QString("Loaded %1 programs.").arg(currentBank.programs.size()));
+    if (filtering) {
+        ui->statusbar->showMessage(QString("%1 of %2 tones match (query %3 ms, total %4 ms)")
+            .arg(hits.size()).arg(workspace.index().size())
+            .arg(queryMs, 0, 'f', 2).arg(timer.nsecsElapsed() / 1e6, 0, 'f', 1));
+    }
 }
 
 void MainWindow::on_treeWidget_itemSelectionChanged() {
@@ -129,23 +505,38 @@ void MainWindow::on_treeWidget_itemSelectionChanged() {
     QTreeWidgetItem* item = items[0];
     int progId = item->data(0, Qt::UserRole).toInt();
     int toneIdx = item->data(0, Qt::UserRole + 1).toInt();
+    u32 bankNo = item->data(0, Qt::UserRole + 2).toUInt();
+    if (bankNo >= workspace.size()) return;
 
-    std::shared_ptr<Program> prog = nullptr;
-    for (auto& p : currentBank.programs) {
-        if (p->id == (u32)progId) { prog = p; break; }
-    }
-    if (!prog) return;
+    const LoadedBank& lb = workspace.bank(bankNo);
+    std::shared_ptr<const Program> prog = workspace.program(bankNo, (u32)progId);
+    if (!prog && toneIdx != -2) return;
 
     clearProperties();
 
-    if (toneIdx == -1) {
+    if (toneIdx < 0) {
+        stream.close();
         currentSample = {};
+        currentReverb = false;
         waveformWidget->clear();
+        spectrogramWidget->clear();
+    }
+
+    if (toneIdx == -2) {
+        size_t tones = 0;
+        for (const auto& p : lb.bank.programs) tones += p->tones.size();
 
+        addProperty("Bank", QString::number(bankNo));
+        addProperty("HD File", lb.hd_path);
+        addProperty("BD File", lb.bd_path);
+        addProperty("Program Count", QString::number(lb.bank.programs.size()));
+        addProperty("Tone Count", QString::number(tones));
+    }
+    else if (toneIdx == -1) {
         addProperty("Program ID", QString::number(prog->id));
         addProperty("Name", QString::fromStdString(prog->name));
-        addProperty("Master Volume", QString::number(prog->master_vol));
-        addProperty("Master Pan", QString::number(prog->master_pan));
+        addProperty("Master Volume", QString::number(prog->master_vol), true);
+        addProperty("Master Pan", QString::number(prog->master_pan), true);
         addProperty("Is Layered?", prog->is_layered ? "Yes" : "No");
         addProperty("Tone Count", QString::number(prog->tones.size()));
     }
@@ -153,19 +544,33 @@ void MainWindow::on_treeWidget_itemSelectionChanged() {
         if (toneIdx >= prog->tones.size()) return;
         const auto& tone = prog->tones[toneIdx];
 
-        auto raw = bdParser.get_adpcm_block(tone.bd_offset);
-        currentSample = BDParser::decode_adpcm(raw, tone.sample_rate);
-
-        waveformWidget->setData(currentSample.pcm, currentSample.looping, currentSample.loop_start, currentSample.loop_end);
+        u64 key = workspace.content_key(bankNo, tone.bd_offset);
+        currentReverb = tone.is_reverb_enabled;
+
+        auto pending = decodeQueue.request(key, lb.bd, tone.bd_offset, tone.sample_rate, DecodeQueue::Selected);
+        prefetchAround(item, key);
+
+        stream.open(pending);
+        currentSample = stream.info();
+        currentSample.sample_rate = tone.sample_rate; // tones can share a sample at different rates
+        if (stream.finished()) {
+            waveformWidget->setData(currentSample.pcm, currentSample.looping, currentSample.loop_start, currentSample.loop_end);
+            spectrogramWidget->setData(currentSample.pcm);
+        } else {
+            // Loop points come from the flag scan, the PCM streams in behind it
+            waveformWidget->beginStream(currentSample.pcm, currentSample.looping, currentSample.loop_start, currentSample.loop_end);
+            spectrogramWidget->clear();
+            streamTimer->start();
+        }
 
-        addProperty("Key Range", QString("%1 - %2").arg(tone.min_note).arg(tone.max_note));
-        addProperty("Root Key", QString::number(tone.root_key));
-        addProperty("Pitch Fine", QString::number(tone.pitch_fine));
-        addProperty("Volume", QString::number(tone.volume));
-        addProperty("Pan", QString::number(tone.pan));
+        addProperty("Key Range", QString("%1 - %2").arg(tone.min_note).arg(tone.max_note), true);
+        addProperty("Root Key", QString::number(tone.root_key), true);
+        addProperty("Pitch Fine", QString::number(tone.pitch_fine), true);
+        addProperty("Volume", QString::number(tone.volume), true);
+        addProperty("Pan", QString::number(tone.pan), true);
 
-        addProperty("ADSR 1 (Raw)", QString("0x%1").arg(tone.adsr1, 4, 16, QChar('0')).toUpper());
-        addProperty("ADSR 2 (Raw)", QString("0x%1").arg(tone.adsr2, 4, 16, QChar('0')).toUpper());
+        addProperty("ADSR 1 (Raw)", QString("0x%1").arg(tone.adsr1, 4, 16, QChar('0')).toUpper(), true);
+        addProperty("ADSR 2 (Raw)", QString("0x%1").arg(tone.adsr2, 4, 16, QChar('0')).toUpper(), true);
 
         addProperty("Attack Mode", (tone.adsr1 & 0x8000) ? "Exponential" : "Linear");
         addProperty("Sustain Level", QString::number(tone.adsr1 & 0xF));
@@ -181,19 +586,63 @@ void MainWindow::on_treeWidget_itemSelectionChanged() {
     }
 }
 
+const Tone* MainWindow::toneForItem(QTreeWidgetItem* item) const {
+    return workspace.tone(item->data(0, Qt::UserRole + 2).toUInt(),
+                          (u32)item->data(0, Qt::UserRole).toInt(),
+                          item->data(0, Qt::UserRole + 1).toInt());
+}
+
+// Queue the next/previous few visible tones behind the selection so arrowing through
+// the tree finds them decoded. Whatever is no longer nearby gets cancelled.
+void MainWindow::prefetchAround(QTreeWidgetItem* item, u64 selectedKey) {
+    const int PREFETCH_TONES = 3;
+
+    std::vector<QTreeWidgetItem*> sides[2];
+    for (int dir = 0; dir < 2; ++dir) {
+        QTreeWidgetItem* it = item;
+        while ((int)sides[dir].size() < PREFETCH_TONES) {
+            it = dir == 0 ? ui->treeWidget->itemBelow(it) : ui->treeWidget->itemAbove(it);
+            if (!it) break;
+            if (toneForItem(it)) sides[dir].push_back(it);
+        }
+    }
+
+    // Closest first, below ahead of above since that is the usual direction of travel
+    std::vector<QTreeWidgetItem*> near;
+    for (int i = 0; i < PREFETCH_TONES; ++i) {
+        if (i < (int)sides[0].size()) near.push_back(sides[0][i]);
+        if (i < (int)sides[1].size()) near.push_back(sides[1][i]);
+    }
+
+    std::vector<u64> keep = { selectedKey };
+    for (QTreeWidgetItem* it : near)
+        keep.push_back(workspace.content_key(it->data(0, Qt::UserRole + 2).toUInt(), toneForItem(it)->bd_offset));
+    decodeQueue.retain(keep);
+
+    for (size_t i = 0; i < near.size(); ++i) {
+        u32 bankNo = near[i]->data(0, Qt::UserRole + 2).toUInt();
+        const Tone* t = toneForItem(near[i]);
+        decodeQueue.request(keep[i + 1], workspace.bank(bankNo).bd, t->bd_offset, t->sample_rate,
+                            DecodeQueue::Prefetch - (int)i);
+    }
+}
+
 void MainWindow::on_btnPlay_clicked() {
     auto items = ui->treeWidget->selectedItems();
     if (items.isEmpty()) return;
 
     int toneIdx = items[0]->data(0, Qt::UserRole + 1).toInt();
-    if (toneIdx == -1) return;
+    if (toneIdx < 0) return;
+
+    if (!stream.is_open() || stream.total_samples() == 0) return;
 
-    if (currentSample.pcm.empty()) return;
+    // callback must not see the ring or the reverb work area while they change
+    if (deviceInit && ma_device_is_started(&device)) ma_device_stop(&device);
+
+    reverb.configure(currentReverb ? ui->cmbReverb->currentIndex() : SpuReverb::Off, currentSample.sample_rate);
 
-    playBuffer = currentSample.pcm;
-    playCursor = 0;
+    stream.start_feed(ui->chkLoop->isChecked());
     isPlaying = true;
-    loopPlayback = ui->chkLoop->isChecked();
 
     if (!deviceInit) {
         ma_device_config config = ma_device_config_init(ma_device_type_playback);
@@ -216,26 +665,218 @@ void MainWindow::on_btnPlay_clicked() {
         ma_device_init(NULL, &config, &device);
     }
 
+    audioStats.set_sample_rate(device.sampleRate);
+    audioStats.mark_stopped();
     if (!ma_device_is_started(&device)) ma_device_start(&device);
+    cursorTimer->start();
 }
 
 void MainWindow::on_btnStop_clicked() {
     isPlaying = false;
-    playCursor = 0;
     if (deviceInit && ma_device_is_started(&device)) ma_device_stop(&device);
+    stream.stop_feed();
+    cursorTimer->stop();
+    waveformWidget->setPlayPosition(-1);
 }
 
 void MainWindow::on_chkLoop_stateChanged(int arg1) {
-    loopPlayback = (arg1 != 0);
+    stream.set_loop(arg1 != 0);
+}
+
+void MainWindow::onWaveformViewChanged(double start, double samplesPerPixel) {
+    int visible = (int)std::ceil(samplesPerPixel * waveformWidget->width());
+    int total = (int)waveformWidget->totalSamples();
+    QSignalBlocker block(waveScroll);
+    waveScroll->setRange(0, std::max(0, total - visible));
+    waveScroll->setPageStep(std::max(1, visible));
+    waveScroll->setSingleStep(std::max(1, visible / 10));
+    waveScroll->setValue((int)start);
+}
+
+void MainWindow::onLoopEdited(int loopStart, int loopEnd) {
+    if (!stream.is_open()) return;
+    currentSample.loop_start = loopStart;
+    currentSample.loop_end = loopEnd;
+    stream.set_loop_points(loopStart, loopEnd);
+    setPropertyValue("Loop Start", QString::number(loopStart));
+    setPropertyValue("Loop End", QString::number(loopEnd));
+}
+
+void MainWindow::pollCursor() {
+    if (!isPlaying) {
+        cursorTimer->stop();
+        waveformWidget->setPlayPosition(-1);
+        return;
+    }
+    waveformWidget->setPlayPosition(stream.play_position());
+}
+
+void MainWindow::pollStream() {
+    if (!stream.is_open()) {
+        streamTimer->stop();
+        return;
+    }
+
+    waveformWidget->setAvailable(stream.decoded());
+    if (stream.finished()) {
+        spectrogramWidget->setData(stream.buffer());
+        streamTimer->stop();
+    }
+}
+
+int MainWindow::selectedBankNo() const {
+    if (workspace.empty()) return -1;
+
+    // Bank of the selected item, the first one otherwise
+    u32 bankNo = 0;
+    auto items = ui->treeWidget->selectedItems();
+    if (!items.isEmpty()) bankNo = items[0]->data(0, Qt::UserRole + 2).toUInt();
+    if (bankNo >= workspace.size() || !workspace.bank(bankNo).bank.valid) return -1;
+    return (int)bankNo;
 }
 
 void MainWindow::on_actionExportSF2_triggered() {
-    if (!currentBank.valid) return;
+    int bankNo = selectedBankNo();
+    if (bankNo < 0) return;
+    const LoadedBank& lb = workspace.bank(bankNo);
+
     QString path = QFileDialog::getSaveFileName(this, "Export SF2", "out.sf2", "SoundFont (*.sf2)");
     if (path.isEmpty()) return;
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    bool ok = Sf2Exporter::exportToSf2(path, currentBank, &bdParser);
+    ExportStats stats;
+    bool ok = Sf2Exporter::exportToSf2(path, lb.bank, &lb.bd, &stats);
+    QApplication::restoreOverrideCursor();
+    if (ok) QMessageBox::information(this, "Success", QString("Export done.\n%1 samples, %2 duplicates merged (%3 KB saved).\n"
+                                                             "%4 programs and %5 samples unchanged since the last export.")
+                                         .arg(stats.samples).arg(stats.duplicates).arg(stats.bytes_saved / 1024)
+                                         .arg(stats.programs_reused).arg(stats.samples_reused));
+    else QMessageBox::critical(this, "Error", "Export failed.");
+}
+
+void MainWindow::on_actionSaveBank_triggered() {
+    int bankNo = selectedBankNo();
+    if (bankNo < 0) return;
+    const LoadedBank& lb = workspace.bank(bankNo);
+    if (!lb.bank.tables) {
+        QMessageBox::critical(this, "Error", "This bank has no HD to save, export it instead.");
+        return;
+    }
+
+    QString hdPath = QFileDialog::getSaveFileName(this, "Save Bank", lb.name, "HD Files (*.hd *.HD)");
+    if (hdPath.isEmpty()) return;
+    QString bdPath = hdPath;
+    if (bdPath.endsWith(".hd", Qt::CaseInsensitive)) bdPath.replace(bdPath.length() - 3, 3, ".bd");
+    else bdPath += ".bd";
+    if (QFileInfo(hdPath) == QFileInfo(lb.hd_path) || QFileInfo(bdPath) == QFileInfo(lb.bd_path)) {
+        // Keep the originals, the bank in memory still points at their offsets
+        QMessageBox::critical(this, "Error", "Choose a different name than the loaded bank.");
+        return;
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool ok = HDWriter::write(hdPath, bdPath, lb.bank, lb.bd);
+    QApplication::restoreOverrideCursor();
+    if (ok) QMessageBox::information(this, "Success", "Saved " + QFileInfo(hdPath).fileName() + " and " + QFileInfo(bdPath).fileName() + ".");
+    else QMessageBox::critical(this, "Error", "Save failed.");
+}
+
+bool MainWindow::askBankMapping(const QString& title, std::vector<ExportBank>& banks) {
+    if (workspace.empty()) return false;
+
+    // "workspace bank:output bank" pairs, banks left out are not exported
+    QString defaultMap;
+    for (size_t i = 0; i < workspace.size(); ++i) defaultMap += QString("%1:%1 ").arg(i);
+
+    bool accepted = false;
+    QString map = QInputDialog::getText(this, title,
+        "Bank mapping (workspace bank:output bank, 128 = percussion):", QLineEdit::Normal, defaultMap.trimmed(), &accepted);
+    if (!accepted) return false;
+
+    banks.clear();
+    for (const QString& pair : map.split(' ', Qt::SkipEmptyParts)) {
+        QStringList parts = pair.split(':');
+        bool okSrc = false, okDst = false;
+        uint src = parts.size() == 2 ? parts[0].toUInt(&okSrc) : 0;
+        uint dst = parts.size() == 2 ? parts[1].toUInt(&okDst) : 0;
+        if (!okSrc || !okDst || src >= workspace.size() || dst > 128) {
+            QMessageBox::critical(this, "Error", QString("Bad mapping entry \"%1\".").arg(pair));
+            return false;
+        }
+        const LoadedBank& lb = workspace.bank(src);
+        if (lb.bank.valid) banks.push_back({ &lb.bank, &lb.bd, (u16)dst });
+    }
+    return !banks.empty();
+}
+
+void MainWindow::on_actionExportAllSF2_triggered() {
+    std::vector<ExportBank> banks;
+    if (!askBankMapping("Export All Banks", banks)) return;
+
+    QString path = QFileDialog::getSaveFileName(this, "Export SF2", "merged.sf2", "SoundFont (*.sf2)");
+    if (path.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    ExportStats stats;
+    bool ok = Sf2Exporter::exportBanksToSf2(path, banks, &stats);
+    QApplication::restoreOverrideCursor();
+    if (ok) QMessageBox::information(this, "Success", QString("Exported %1 banks.\n%2 samples, %3 duplicates merged (%4 KB saved).\n"
+                                                             "%5 programs and %6 samples unchanged since the last export.")
+                                         .arg(banks.size()).arg(stats.samples).arg(stats.duplicates).arg(stats.bytes_saved / 1024)
+                                         .arg(stats.programs_reused).arg(stats.samples_reused));
+    else QMessageBox::critical(this, "Error", "Export failed.");
+}
+
+void MainWindow::on_actionExportAllSFZ_triggered() {
+    std::vector<ExportBank> banks;
+    if (!askBankMapping("Export All Banks to SFZ", banks)) return;
+
+    QString dir = QFileDialog::getExistingDirectory(this, "Export SFZ");
+    if (dir.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    ExportStats stats;
+    bool ok = SfzExporter::exportBanks(dir, banks, &stats);
     QApplication::restoreOverrideCursor();
-    if (ok) QMessageBox::information(this, "Success", "Export done.");
+    if (ok) QMessageBox::information(this, "Success", QString("Exported %1 banks.\n%2 samples, %3 duplicates merged (%4 KB saved).")
+                                         .arg(banks.size()).arg(stats.samples).arg(stats.duplicates).arg(stats.bytes_saved / 1024));
     else QMessageBox::critical(this, "Error", "Export failed.");
 }
+
+void MainWindow::on_actionExportAllDLS_triggered() {
+    std::vector<ExportBank> banks;
+    if (!askBankMapping("Export All Banks to DLS", banks)) return;
+
+    QString path = QFileDialog::getSaveFileName(this, "Export DLS", "merged.dls", "DLS Collection (*.dls)");
+    if (path.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    ExportStats stats;
+    bool ok = DlsWriter::exportBanks(path, banks, &stats);
+    QApplication::restoreOverrideCursor();
+    if (ok) QMessageBox::information(this, "Success", QString("Exported %1 banks.\n%2 samples, %3 duplicates merged (%4 KB saved).")
+                                         .arg(banks.size()).arg(stats.samples).arg(stats.duplicates).arg(stats.bytes_saved / 1024));
+    else QMessageBox::critical(this, "Error", "Export failed.");
+}
+
+void MainWindow::on_actionExtractWAV_triggered() {
+    // Files are named after the workspace bank, there is no program numbering to map
+    std::vector<ExportBank> banks;
+    for (size_t i = 0; i < workspace.size(); ++i) {
+        const LoadedBank& lb = workspace.bank(i);
+        if (lb.bank.valid) banks.push_back({ &lb.bank, &lb.bd, (u16)i });
+    }
+    if (banks.empty()) return;
+
+    QString dir = QFileDialog::getExistingDirectory(this, "Extract WAV");
+    if (dir.isEmpty()) return;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QElapsedTimer timer;
+    timer.start();
+    ExportStats stats;
+    bool ok = WavExtractor::extract(dir, banks, &stats);
+    QApplication::restoreOverrideCursor();
+    if (ok) QMessageBox::information(this, "Success", QString("Extracted %1 samples in %2 s.\n%3 duplicates skipped.")
+                                         .arg(stats.samples).arg(timer.elapsed() / 1000.0, 0, 'f', 1).arg(stats.duplicates));
+    else QMessageBox::critical(this, "Error", "Extraction failed.");
+}
@@ -4,11 +4,22 @@
 #include <QMainWindow>
 #include <QTreeWidget>
 #include <QTableWidget>
+#include <QLabel>
+#include <QTimer>
+#include <QScrollBar>
 #include "main.h"
 #include "hd.h"
 #include "bd.h"
+#include "workspace.h"
+#include "exportplan.h"
+#include "reverb.h"
+#include "audiostats.h"
+#include "previewstream.h"
+#include "decodequeue.h"
 #include "miniaudio.h"
 #include "waveform.h"
+#include "spectrogram.h"
+#include "thumbnails.h"
 
 namespace Ui { class MainWindow; }
 
@@ -21,31 +32,71 @@ public:
 
 private slots:
     void on_actionOpen_HD_triggered();
+    void on_actionCloseAll_triggered();
+    void on_editFilter_textChanged(const QString& text);
     void on_actionExportSF2_triggered();
+    void on_actionExportAllSF2_triggered();
+    void on_actionExportAllSFZ_triggered();
+    void on_actionExportAllDLS_triggered();
+    void on_actionExtractWAV_triggered();
+    void on_actionSaveBank_triggered();
+    void on_actionImportSF2_triggered();
+    void on_actionCarveBD_triggered();
+    void on_actionOpenImage_triggered();
+    void on_actionOpenVAG_triggered();
+    void on_actionDecodeVAG_triggered();
+    void on_actionUndo_triggered();
+    void on_actionRedo_triggered();
     void on_treeWidget_itemSelectionChanged();
     void on_btnPlay_clicked();
     void on_btnStop_clicked();
     void on_chkLoop_stateChanged(int arg1);
+    void on_actionDumpAudioStats_triggered();
+    void refreshAudioStats();
+    void pollStream();
+    void pollCursor();
+    void onWaveformViewChanged(double start, double samplesPerPixel);
+    void onLoopEdited(int loopStart, int loopEnd);
+    void onPropertyEdited(QTableWidgetItem* item);
 
 private:
-    void addProperty(const QString& key, const QString& value);
+    int selectedBankNo() const;
+    bool askBankMapping(const QString& title, std::vector<ExportBank>& banks);
+    bool openBank(const QString& hdPath, const QString& bdPath);
+    void showNewBank(int bankNo);
+    void addProperty(const QString& key, const QString& value, bool editable = false);
+    void setPropertyValue(const QString& key, const QString& value);
     void clearProperties();
+    const Tone* toneForItem(QTreeWidgetItem* item) const;
+    void prefetchAround(QTreeWidgetItem* item, u64 selectedKey);
+    void addBankToTree(int bankNo);
+    void refreshBank(int bankNo);
+    void applyFilter(const QString& text);
 
     Ui::MainWindow *ui;
     WaveformWidget *waveformWidget;
+    SpectrogramWidget *spectrogramWidget;
+    ThumbnailDelegate *thumbDelegate;
+    QScrollBar *waveScroll;
 
-    HDParser hdParser;
-    BDParser bdParser;
-    Bank currentBank;
+    Workspace workspace;
     DecodedSample currentSample;
 
     ma_device device;
     bool deviceInit = false;
 
-    std::vector<s16> playBuffer;
-    size_t playCursor = 0;
+    PreviewStream stream;
+    QTimer *streamTimer;
+    QTimer *cursorTimer;
+    DecodeQueue decodeQueue;
     bool isPlaying = false;
-    bool loopPlayback = false;
+
+    SpuReverb reverb;
+    bool currentReverb = false;
+
+    AudioStats audioStats;
+    QLabel *statsLabel;
+    QTimer *statsTimer;
 
     static void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
 };
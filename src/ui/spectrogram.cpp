@@ -0,0 +1,143 @@
+#include "spectrogram.h"
+#include "fft.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+static const float DB_FLOOR = -100.0f;
+
+// black -> blue -> magenta -> orange -> yellow
+static QRgb heat(float db) {
+    static QRgb lut[256];
+    static bool init = false;
+    if (!init) {
+        const float stops[][3] = { {0, 0, 0}, {0, 0, 140}, {170, 0, 170}, {255, 120, 0}, {255, 255, 160} };
+        for (int i = 0; i < 256; ++i) {
+            float t = i / 255.0f * 4.0f;
+            int s = std::min(3, (int)t);
+            float f = t - s;
+            lut[i] = qRgb((int)(stops[s][0] + (stops[s + 1][0] - stops[s][0]) * f),
+                          (int)(stops[s][1] + (stops[s + 1][1] - stops[s][1]) * f),
+                          (int)(stops[s][2] + (stops[s + 1][2] - stops[s][2]) * f));
+        }
+        init = true;
+    }
+    int idx = (int)((db - DB_FLOOR) / -DB_FLOOR * 255.0f);
+    return lut[std::clamp(idx, 0, 255)];
+}
+
+SpectrogramWidget::SpectrogramWidget(QWidget *parent) : QWidget(parent),
+    m_liveGen(std::make_shared<std::atomic<quint64>>(0)), m_tiles(256) {
+    setMinimumHeight(100);
+    m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() - 1));
+    heat(0); // build the LUT on the GUI thread before any worker touches it
+}
+
+SpectrogramWidget::~SpectrogramWidget() {
+    m_liveGen->store(~0ull);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void SpectrogramWidget::cancelPending() {
+    m_pool.clear();
+    m_pending.clear();
+}
+
+void SpectrogramWidget::setData(const PcmBuffer& pcm) {
+    if (pcm == m_pcm) return;
+    cancelPending();
+    m_tiles.clear();
+    m_pcm = pcm;
+    m_liveGen->store(++m_gen);
+    update();
+}
+
+void SpectrogramWidget::clear() {
+    setData(nullptr);
+}
+
+void SpectrogramWidget::setView(double start, double samplesPerPixel) {
+    m_start = start;
+    m_spp = samplesPerPixel;
+    // Tiles queued for the previous view are most likely off screen now
+    cancelPending();
+    update();
+}
+
+void SpectrogramWidget::requestTile(int hopLog2, qint64 tile) {
+    quint64 key = ((quint64)hopLog2 << 40) | (quint64)tile;
+    if (m_pending.contains(key)) return;
+    m_pending.insert(key);
+
+    PcmBuffer pcm = m_pcm;
+    quint64 gen = m_gen;
+    auto live = m_liveGen;
+
+    m_pool.start([this, pcm, gen, live, key, hopLog2, tile]() {
+        if (live->load() != gen) return;
+
+        RealFft fft(FFT_SIZE);
+        const size_t bins = fft.bins();
+        const s64 hop = (s64)1 << hopLog2;
+        const s64 total = (s64)pcm->size();
+        std::vector<s16> frame(FFT_SIZE);
+        std::vector<float> db(bins);
+
+        QImage img(TILE_COLS, (int)bins, QImage::Format_RGB32);
+        for (int c = 0; c < TILE_COLS; ++c) {
+            s64 center = (tile * TILE_COLS + c) * hop + hop / 2;
+            s64 begin = center - FFT_SIZE / 2;
+
+            // zero-pad frames that hang off either end
+            for (int i = 0; i < FFT_SIZE; ++i) {
+                s64 p = begin + i;
+                frame[i] = (p >= 0 && p < total) ? (*pcm)[p] : 0;
+            }
+            fft.power_db(frame.data(), db.data());
+
+            for (size_t k = 0; k < bins; ++k)
+                img.setPixel(c, (int)(bins - 1 - k), heat(db[k]));
+        }
+
+        if (live->load() != gen) return;
+        QMetaObject::invokeMethod(this, [this, gen, key, img]() { tileReady(gen, key, img); }, Qt::QueuedConnection);
+    });
+}
+
+void SpectrogramWidget::tileReady(quint64 gen, quint64 key, const QImage& img) {
+    m_pending.remove(key);
+    if (gen != m_gen) return;
+    m_tiles.insert(key, new QImage(img));
+    update();
+}
+
+void SpectrogramWidget::paintEvent(QPaintEvent *event) {
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (!m_pcm || m_pcm->empty() || m_spp <= 0) return;
+
+    // Hop snaps to a power of two so nearby zoom levels share tiles
+    int hopLog2 = std::max(0, (int)std::lround(std::log2(m_spp)));
+    double hop = (double)((s64)1 << hopLog2);
+    double tileSpan = hop * TILE_COLS;
+
+    double end = std::min(m_start + width() * m_spp, (double)m_pcm->size());
+    qint64 first = (qint64)std::floor(m_start / tileSpan);
+    qint64 last = (qint64)std::floor((end - 1) / tileSpan);
+
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    for (qint64 t = first; t <= last; ++t) {
+        double x0 = (t * tileSpan - m_start) / m_spp;
+        double x1 = ((t + 1) * tileSpan - m_start) / m_spp;
+        quint64 key = ((quint64)hopLog2 << 40) | (quint64)t;
+
+        if (QImage* img = m_tiles.object(key))
+            painter.drawImage(QRectF(x0, 0, x1 - x0, height()), *img);
+        else
+            requestTile(hopLog2, t);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef SPECTROGRAMWIDGET_H
+#define SPECTROGRAMWIDGET_H
+#include <QWidget>
+#include <QCache>
+#include <QImage>
+#include <QSet>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include "bd.h"
+
+// Spectrogram that tracks the waveform view. Columns are computed off the GUI thread
+// in tiles of TILE_COLS, keyed by (hop, tile) so scrolling and zooming back reuse them.
+class SpectrogramWidget : public QWidget {
+    Q_OBJECT
+public:
+    static const int FFT_SIZE = 512;
+    static const int TILE_COLS = 64;
+
+    explicit SpectrogramWidget(QWidget *parent = nullptr);
+    ~SpectrogramWidget();
+
+    void setData(const PcmBuffer& pcm);
+    void clear();
+
+public slots:
+    void setView(double start, double samplesPerPixel);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    void requestTile(int hopLog2, qint64 tile);
+    void tileReady(quint64 gen, quint64 key, const QImage& img);
+    void cancelPending();
+
+    PcmBuffer m_pcm;
+    double m_start = 0;
+    double m_spp = 1;
+
+    // Bumped on every new sample, running tasks for an older one drop their work
+    quint64 m_gen = 0;
+    std::shared_ptr<std::atomic<quint64>> m_liveGen;
+
+    QCache<quint64, QImage> m_tiles;
+    QSet<quint64> m_pending;
+    QThreadPool m_pool;
+};
+#endif // SPECTROGRAMWIDGET_H
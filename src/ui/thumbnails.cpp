@@ -0,0 +1,141 @@
+#include "thumbnails.h"
+#include <QPainter>
+#include <QScrollBar>
+#include <QThread>
+#include <algorithm>
+
+// How often samples still decoding are checked on
+static const int POLL_MS = 40;
+
+ThumbnailDelegate::ThumbnailDelegate(QAbstractItemView *view, DecodeQueue *queue) : QStyledItemDelegate(view),
+    m_view(view), m_queue(queue), m_liveGen(std::make_shared<std::atomic<quint64>>(0)), m_thumbs(16384) {
+    m_pool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 2));
+    m_poll.setInterval(POLL_MS);
+    connect(&m_poll, &QTimer::timeout, this, &ThumbnailDelegate::poll);
+
+    // Rows that scrolled past are not worth decoding anymore, the ones now
+    // visible ask again when they paint
+    connect(view->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() { cancelPending(); });
+}
+
+ThumbnailDelegate::~ThumbnailDelegate() {
+    m_liveGen->store(~0ull);
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void ThumbnailDelegate::cancelPending() {
+    std::vector<u64> keys;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+        if (it.value()) keys.push_back(it.key());
+    m_queue->cancel(keys);
+    m_pool.clear();
+    m_pending.clear();
+    m_poll.stop();
+}
+
+void ThumbnailDelegate::addSource(const BDParser *bd) {
+    m_sources.push_back(bd);
+    m_view->viewport()->update();
+}
+
+void ThumbnailDelegate::clearSources() {
+    m_liveGen->store(++m_gen);
+    cancelPending();
+    m_pool.waitForDone();
+    m_thumbs.clear();
+    m_sources.clear();
+    m_view->viewport()->update();
+}
+
+QSize ThumbnailDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    QSize s = QStyledItemDelegate::sizeHint(option, index);
+    return QSize(std::max(s.width(), THUMB_W + 4), std::max(s.height(), THUMB_H + 2));
+}
+
+void ThumbnailDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const {
+    QStyledItemDelegate::paint(painter, option, index); // selection/hover background
+
+    QVariant v = index.data(Qt::UserRole);
+    if (!v.isValid()) return;
+    quint64 key = v.toULongLong();
+
+    const Summary* peaks = m_thumbs.object(key);
+    if (!peaks) {
+        request(index, key);
+        return;
+    }
+    if (peaks->empty()) return;
+
+    QRect r(option.rect.left() + 2, option.rect.center().y() - THUMB_H / 2, THUMB_W, THUMB_H);
+    painter->save();
+    painter->setPen(QColor(0, 200, 100));
+    const float mid = (THUMB_H - 1) / 2.0f;
+    for (int x = 0; x < THUMB_W; ++x) {
+        const PeakPyramid::Peak& pk = (*peaks)[x];
+        int y0 = (int)(mid - pk.max / 32768.0f * mid);
+        int y1 = (int)(mid - pk.min / 32768.0f * mid);
+        painter->drawLine(r.left() + x, r.top() + y0, r.left() + x, r.top() + y1);
+    }
+    painter->restore();
+}
+
+void ThumbnailDelegate::request(const QModelIndex &index, quint64 key) const {
+    if (m_pending.contains(key)) return;
+    quint64 loc = index.data(Qt::UserRole + 1).toULongLong();
+    u32 rate = index.data(Qt::UserRole + 2).toUInt();
+    if ((loc >> 32) >= m_sources.size()) return;
+
+    m_pending.insert(key, m_queue->request(key, *m_sources[loc >> 32], (u32)loc, rate, DecodeQueue::Background));
+    if (!m_poll.isActive()) m_poll.start();
+}
+
+void ThumbnailDelegate::poll() {
+    bool repaint = false;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        std::shared_ptr<const PendingSample> sample = it.value();
+        if (!sample || (!sample->finished() && !sample->cancelled.load(std::memory_order_acquire))) {
+            ++it;
+            continue;
+        }
+        if (!sample->finished()) {
+            // Someone else's retain() took it, the row asks again when it repaints
+            it = m_pending.erase(it);
+            repaint = true;
+            continue;
+        }
+
+        // Reduced off the GUI thread, one min/max bar per pixel column
+        quint64 key = it.key();
+        quint64 gen = m_gen;
+        auto live = m_liveGen;
+        m_pool.start([this, sample, gen, live, key]() {
+            if (live->load() != gen) return;
+            Summary peaks;
+            const std::vector<s16>* pcm = sample->info.pcm.get();
+            if (pcm && !pcm->empty()) {
+                peaks.resize(THUMB_W);
+                for (int x = 0; x < THUMB_W; ++x) {
+                    size_t b = pcm->size() * x / THUMB_W;
+                    size_t e = std::max(b + 1, pcm->size() * (x + 1) / THUMB_W);
+                    peaks[x] = PeakPyramid::scan(pcm->data() + b, std::min(e, pcm->size()) - b);
+                }
+            }
+            if (live->load() != gen) return;
+            QMetaObject::invokeMethod(this, [this, gen, key, peaks]() { summaryReady(gen, key, peaks); }, Qt::QueuedConnection);
+        });
+        it.value() = nullptr;
+        ++it;
+    }
+
+    bool decoding = std::any_of(m_pending.begin(), m_pending.end(), [](const auto& s) { return s != nullptr; });
+    if (!decoding) m_poll.stop();
+    if (repaint) m_view->viewport()->update();
+}
+
+void ThumbnailDelegate::summaryReady(quint64 gen, quint64 key, const Summary& peaks) {
+    if (gen != m_gen) return;
+    m_pending.remove(key);
+    m_thumbs.insert(key, new Summary(peaks));
+    m_view->viewport()->update();
+}
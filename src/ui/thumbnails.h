@@ -0,0 +1,62 @@
+#ifndef THUMBNAILS_H
+#define THUMBNAILS_H
+#include <QStyledItemDelegate>
+#include <QAbstractItemView>
+#include <QCache>
+#include <QHash>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "bd.h"
+#include "decodequeue.h"
+#include "peaks.h"
+
+// Paints a small waveform in the tree's thumbnail column. Only rows that actually get
+// painted ask for one: the PCM comes through the shared DecodeQueue (and its cache) at
+// background priority, a pool reduces it to one min/max pair per pixel column, and that
+// summary is what gets cached per sample content.
+// Rows carry in their thumbnail column Qt::UserRole = Workspace::content_key(),
+// +1 = Workspace::sample_key() and +2 = the tone's sample rate.
+class ThumbnailDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    static const int THUMB_W = 96;
+    static const int THUMB_H = 18;
+
+    ThumbnailDelegate(QAbstractItemView *view, DecodeQueue *queue);
+    ~ThumbnailDelegate();
+
+    // Bank n of the sample key reads from the n-th source.
+    // Sources must outlive clearSources(), which waits for running summaries and drops the
+    // cache. The queue has to be cleared before the sources go.
+    void addSource(const BDParser *bd);
+    void clearSources();
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+private:
+    using Summary = std::vector<PeakPyramid::Peak>;
+
+    void request(const QModelIndex &index, quint64 key) const;
+    void poll();
+    void summaryReady(quint64 gen, quint64 key, const Summary& peaks);
+    void cancelPending();
+
+    QAbstractItemView *m_view;
+    DecodeQueue *m_queue;
+    std::vector<const BDParser*> m_sources;
+
+    quint64 m_gen = 0;
+    std::shared_ptr<std::atomic<quint64>> m_liveGen;
+
+    // paint() is const, the lazy bits behind it are not. Pending entries are still
+    // decoding, null once handed to the pool for reduction.
+    mutable QCache<quint64, Summary> m_thumbs;
+    mutable QHash<quint64, std::shared_ptr<const PendingSample>> m_pending;
+    mutable QTimer m_poll;
+    QThreadPool m_pool;
+};
+#endif // THUMBNAILS_H
@@ -1,58 +1,298 @@
 #include "waveform.h"
 #include <QPainter>
+#include <QVector>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QPaintEvent>
+#include <algorithm>
+#include <cmath>
+
+static const double MIN_SPP = 1.0 / 32.0;
+static const double ZOOM_STEP = 1.25;
+static const int MARKER_GRAB = 4;
+static const int ADPCM_BLOCK = 28;
 
 WaveformWidget::WaveformWidget(QWidget *parent) : QWidget(parent) {
     setBackgroundRole(QPalette::Base);
     setAutoFillBackground(true);
     setMinimumHeight(100);
+    setMouseTracking(true);
+
+    m_anim.setInterval(16);
+    connect(&m_anim, &QTimer::timeout, this, &WaveformWidget::stepAnimation);
 }
 
-void WaveformWidget::setData(const std::vector<int16_t>& pcmData, bool looping, int loopStart, int loopEnd) {
-    m_data = pcmData;
+void WaveformWidget::setData(const PcmBuffer& pcm, bool looping, int loopStart, int loopEnd) {
+    m_pcm = pcm;
+    m_total = m_avail = m_pcm ? m_pcm->size() : 0;
+    m_peaks.build(m_pcm ? m_pcm->data() : nullptr, m_avail);
     m_loop = looping;
     m_ls = loopStart;
     m_le = loopEnd;
-    update();
+    zoomToFit();
+}
+
+void WaveformWidget::beginStream(const PcmBuffer& pcm, bool looping, int loopStart, int loopEnd) {
+    m_pcm = pcm;
+    m_avail = 0;
+    m_total = m_pcm ? m_pcm->size() : 0;
+    m_peaks.clear();
+    m_loop = looping;
+    m_ls = loopStart;
+    m_le = loopEnd;
+    zoomToFit();
+}
+
+void WaveformWidget::setAvailable(size_t available) {
+    if (!m_pcm) return;
+    available = std::min(available, m_total);
+    if (available <= m_avail) return;
+    m_peaks.append(m_pcm->data() + m_avail, available - m_avail);
+    m_avail = available;
+    invalidate();
 }
 
 void WaveformWidget::clear() {
-    m_data.clear();
+    m_pcm.reset();
+    m_avail = 0;
+    m_total = 0;
+    m_peaks.clear();
+    m_playPos = -1;
     m_loop = false;
     m_ls = 0;
     m_le = 0;
+    zoomToFit();
+}
+
+double WaveformWidget::fitSpp() const {
+    if (m_total == 0 || width() <= 0) return 1.0;
+    return std::max(MIN_SPP, (double)m_total / width());
+}
+
+double WaveformWidget::clampStart(double start, double spp) const {
+    double maxStart = std::max(0.0, (double)m_total - spp * width());
+    return std::clamp(start, 0.0, maxStart);
+}
+
+void WaveformWidget::zoomToFit() {
+    m_anim.stop();
+    m_fit = true;
+    m_spp = m_targetSpp = fitSpp();
+    m_start = m_targetStart = 0;
+    emit viewChanged(m_start, m_spp);
+    invalidate();
+}
+
+void WaveformWidget::setViewStart(double start) {
+    start = clampStart(start, m_targetSpp);
+    if (start == m_targetStart && start == m_start) return;
+    m_targetStart = m_start = start;
+    emit viewChanged(m_start, m_spp);
+    invalidate();
+}
+
+void WaveformWidget::animateTo(double start, double spp) {
+    m_targetSpp = std::clamp(spp, MIN_SPP, fitSpp());
+    m_targetStart = clampStart(start, m_targetSpp);
+    m_fit = (m_targetSpp >= fitSpp());
+    if (!m_anim.isActive()) m_anim.start();
+}
+
+void WaveformWidget::stepAnimation() {
+    // Ease in log space for zoom so every notch feels the same length
+    const double k = 0.35;
+    double ls = std::log(m_spp), lt = std::log(m_targetSpp);
+    double spp = std::exp(ls + (lt - ls) * k);
+    double start = m_start + (m_targetStart - m_start) * k;
+
+    bool done = std::fabs(lt - std::log(spp)) < 1e-3 && std::fabs(m_targetStart - start) < spp * 0.5;
+    if (done) {
+        spp = m_targetSpp;
+        start = m_targetStart;
+        m_anim.stop();
+    }
+
+    m_spp = spp;
+    m_start = clampStart(start, spp);
+    emit viewChanged(m_start, m_spp);
+    invalidate();
+}
+
+void WaveformWidget::invalidate() {
+    m_layerDirty = true;
     update();
 }
 
-void WaveformWidget::paintEvent(QPaintEvent *event) {
+QRect WaveformWidget::cursorRect(double sample) const {
+    if (sample < 0) return QRect();
+    int x = (int)std::lround(sampleToX(sample));
+    return QRect(x - 1, 0, 3, height());
+}
+
+void WaveformWidget::setPlayPosition(double sample) {
+    QRect before = cursorRect(m_playPos);
+    m_playPos = sample;
+    QRect after = cursorRect(m_playPos);
+    if (before == after) return;
+    if (!before.isNull()) update(before);
+    if (!after.isNull()) update(after);
+}
+
+void WaveformWidget::resizeEvent(QResizeEvent *event) {
+    QWidget::resizeEvent(event);
+    m_layerDirty = true;
+    if (m_fit) {
+        zoomToFit();
+    } else {
+        m_targetSpp = m_spp = std::min(m_spp, fitSpp());
+        m_targetStart = m_start = clampStart(m_start, m_spp);
+        emit viewChanged(m_start, m_spp);
+    }
+}
+
+void WaveformWidget::wheelEvent(QWheelEvent *event) {
+    if (m_total == 0) return;
+    QPoint delta = event->angleDelta();
+    double x = event->position().x();
+
+    // Shift or a horizontal wheel scrolls, plain wheel zooms around the mouse
+    if ((event->modifiers() & Qt::ShiftModifier) || delta.x() != 0) {
+        int d = (delta.x() != 0) ? delta.x() : delta.y();
+        double px = -d / 120.0 * width() * 0.15;
+        animateTo(m_targetStart + px * m_targetSpp, m_targetSpp);
+    } else if (delta.y() != 0) {
+        double notches = delta.y() / 120.0;
+        double spp = m_targetSpp * std::pow(ZOOM_STEP, -notches);
+        spp = std::clamp(spp, MIN_SPP, fitSpp());
+        double anchor = m_targetStart + x * m_targetSpp;
+        animateTo(anchor - x * spp, spp);
+    }
+    event->accept();
+}
+
+void WaveformWidget::mousePressEvent(QMouseEvent *event) {
+    if (m_total == 0) return;
+    double x = event->position().x();
+
+    if (event->button() == Qt::LeftButton && m_loop) {
+        if (std::fabs(sampleToX(m_ls) - x) <= MARKER_GRAB) { m_drag = Drag::LoopStart; return; }
+        if (std::fabs(sampleToX(m_le) - x) <= MARKER_GRAB) { m_drag = Drag::LoopEnd; return; }
+    }
+    if (event->button() == Qt::LeftButton || event->button() == Qt::MiddleButton) {
+        m_drag = Drag::Pan;
+        m_dragAnchor = xToSample(x);
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void WaveformWidget::mouseMoveEvent(QMouseEvent *event) {
+    double x = event->position().x();
+
+    if (m_drag == Drag::Pan) {
+        m_anim.stop();
+        m_targetSpp = m_spp;
+        setViewStart(m_dragAnchor - x * m_spp);
+        return;
+    }
+
+    if (m_drag == Drag::LoopStart || m_drag == Drag::LoopEnd) {
+        int s = (int)std::lround(xToSample(x) / ADPCM_BLOCK) * ADPCM_BLOCK;
+        if (m_drag == Drag::LoopStart) m_ls = std::clamp(s, 0, std::max(0, m_le - ADPCM_BLOCK));
+        else m_le = std::clamp(s, m_ls + ADPCM_BLOCK, std::max(m_ls + ADPCM_BLOCK, (int)m_total));
+        invalidate();
+        return;
+    }
+
+    bool onMarker = m_loop && (std::fabs(sampleToX(m_ls) - x) <= MARKER_GRAB || std::fabs(sampleToX(m_le) - x) <= MARKER_GRAB);
+    setCursor(onMarker ? Qt::SizeHorCursor : Qt::ArrowCursor);
+}
+
+void WaveformWidget::mouseReleaseEvent(QMouseEvent *event) {
     Q_UNUSED(event);
-    QPainter painter(this);
+    if (m_drag == Drag::LoopStart || m_drag == Drag::LoopEnd) emit loopChanged(m_ls, m_le);
+    m_drag = Drag::None;
+    setCursor(Qt::ArrowCursor);
+}
+
+void WaveformWidget::renderLayer() {
+    qreal dpr = devicePixelRatioF();
+    QSize px = size() * dpr;
+    if (m_layer.size() != px) m_layer = QPixmap(px);
+    m_layer.setDevicePixelRatio(dpr);
+    m_layerDirty = false;
+
+    QPainter painter(&m_layer);
     painter.fillRect(rect(), Qt::black);
-    if (m_data.empty()) return;
+    if (!m_pcm || m_avail == 0) return;
+    const int16_t* data = m_pcm->data();
     painter.setPen(QColor(0, 255, 127));
 
     int w = width();
     int h = height();
     int cy = h / 2;
-    double step = (double)m_data.size() / w;
-    if (step < 1.0) step = 1.0;
+    auto yOf = [&](int v) { return cy - (int)((v / 32768.0) * (h / 2)); };
+
+    if (m_spp < 1.0) {
+        // Zoomed past one sample per pixel: straight polyline, dots once they spread out
+        size_t first = (size_t)std::max(0.0, std::floor(m_start));
+        size_t last = std::min(m_avail, (size_t)std::ceil(xToSample(w)) + 1);
+        QVector<QPointF> pts;
+        if (last > first) pts.reserve((int)(last - first));
+        for (size_t i = first; i < last; ++i)
+            pts.append(QPointF(sampleToX((double)i), yOf(data[i])));
+        painter.drawPolyline(pts.constData(), pts.size());
+        if (m_spp < 1.0 / 8.0) {
+            painter.setPen(QPen(QColor(0, 255, 127), 3));
+            painter.drawPoints(pts.constData(), pts.size());
+        }
+    } else {
+        // One min/max span per column, RMS drawn inside it. Raw PCM below a bucket, pyramid above.
+        QVector<QLine> spans, rms;
+        spans.reserve(w);
+        rms.reserve(w);
+        for (int x = 0; x < w; ++x) {
+            size_t b = (size_t)xToSample(x);
+            size_t e = std::min((size_t)xToSample(x + 1), m_avail);
+            if (b >= e) break;
 
-    int px = 0, py = cy;
-    for (int x = 0; x < w; ++x) {
-        int idx = (int)(x * step);
-        if (idx >= m_data.size()) break;
-        int y = cy - (int)((m_data[idx] / 32768.0) * (h / 2));
-        painter.drawLine(px, py, x, y);
-        px = x; py = y;
+            PeakPyramid::Peak p = (e - b < PeakPyramid::BASE) ? PeakPyramid::scan(data + b, e - b)
+                                                              : m_peaks.query(b, e);
+            spans.append(QLine(x, yOf(p.max), x, yOf(p.min)));
+            int r = (int)((p.rms / 32768.0) * (h / 2));
+            rms.append(QLine(x, cy - r, x, cy + r));
+        }
+        painter.setPen(QColor(0, 150, 75));
+        painter.drawLines(spans);
+        painter.setPen(QColor(0, 255, 127));
+        painter.drawLines(rms);
     }
 
-    if (m_loop && m_le > m_ls && m_ls >= 0 && m_le <= (int)m_data.size()) {
+    if (m_loop && m_le > m_ls && m_ls >= 0 && m_le <= (int)m_total) {
+        // loop end sitting on the last sample lands one past the widget in fit view
+        int x0 = (int)std::lround(sampleToX(m_ls));
+        int x1 = (int)std::lround(sampleToX(m_le));
+        if (x1 == w) x1 = w - 1;
+        int f0 = std::max(x0, 0), f1 = std::min(x1, w);
+        if (f1 > f0) painter.fillRect(QRect(f0, 0, f1 - f0, h), QColor(255, 200, 0, 24));
         painter.setPen(QColor(255, 200, 0));
-        double inv = (step >= 1.0) ? step : 1.0;
-        int x0 = (int)(m_ls / inv);
-        int x1 = (int)(m_le / inv);
-        if (x0 < 0) x0 = 0; if (x0 >= w) x0 = w - 1;
-        if (x1 < 0) x1 = 0; if (x1 >= w) x1 = w - 1;
-        painter.drawLine(x0, 0, x0, h);
-        painter.drawLine(x1, 0, x1, h);
+        if (x0 >= 0 && x0 < w) painter.drawLine(x0, 0, x0, h);
+        if (x1 >= 0 && x1 < w) painter.drawLine(x1, 0, x1, h);
+    }
+}
+
+void WaveformWidget::paintEvent(QPaintEvent *event) {
+    if (m_layerDirty) renderLayer();
+
+    QPainter painter(this);
+    QRect r = event->rect();
+    qreal dpr = m_layer.devicePixelRatio();
+    painter.drawPixmap(r, m_layer, QRectF(r.x() * dpr, r.y() * dpr, r.width() * dpr, r.height() * dpr));
+
+    if (m_playPos >= 0) {
+        int x = (int)std::lround(sampleToX(m_playPos));
+        if (x >= 0 && x < width()) {
+            painter.setPen(QColor(255, 255, 255));
+            painter.drawLine(x, 0, x, height());
+        }
     }
 }
@@ -1,21 +1,79 @@
 #ifndef WAVEFORMWIDGET_H
 #define WAVEFORMWIDGET_H
 #include <QWidget>
+#include <QTimer>
+#include <QPixmap>
 #include <vector>
 #include <cstdint>
+#include "peaks.h"
+#include "bd.h"
 
 class WaveformWidget : public QWidget {
     Q_OBJECT
 public:
     explicit WaveformWidget(QWidget *parent = nullptr);
-    void setData(const std::vector<int16_t>& pcmData, bool looping = false, int loopStart = 0, int loopEnd = 0);
+    // The buffer is shared, not copied
+    void setData(const PcmBuffer& pcm, bool looping = false, int loopStart = 0, int loopEnd = 0);
+    // Progressive fill of a buffer that is still being decoded: only [0, available) is read
+    void beginStream(const PcmBuffer& pcm, bool looping = false, int loopStart = 0, int loopEnd = 0);
+    void setAvailable(size_t available);
     void clear();
+
+    // View in samples. Zoom goes from fit-to-width down to MIN_SPP samples per pixel.
+    double viewStart() const { return m_start; }
+    double samplesPerPixel() const { return m_spp; }
+    size_t totalSamples() const { return m_total; }
+    void setViewStart(double start);
+    void zoomToFit();
+
+    // Play cursor in samples, negative hides it. Only the cursor strip is repainted.
+    void setPlayPosition(double sample);
+
+signals:
+    void viewChanged(double start, double samplesPerPixel);
+    // Emitted once a marker drag ends, points are snapped to ADPCM blocks
+    void loopChanged(int loopStart, int loopEnd);
+
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
 private:
-    std::vector<int16_t> m_data;
+    enum class Drag { None, Pan, LoopStart, LoopEnd };
+
+    double fitSpp() const;
+    double clampStart(double start, double spp) const;
+    void animateTo(double start, double spp);
+    void stepAnimation();
+    void invalidate();
+    void renderLayer();
+    QRect cursorRect(double sample) const;
+    double xToSample(double x) const { return m_start + x * m_spp; }
+    double sampleToX(double s) const { return (s - m_start) / m_spp; }
+
+    PcmBuffer m_pcm;
+    size_t m_avail = 0;
+    size_t m_total = 0;
+    PeakPyramid m_peaks;
     bool m_loop = false;
     int m_ls = 0;
     int m_le = 0;
+
+    double m_start = 0, m_spp = 1;
+    double m_targetStart = 0, m_targetSpp = 1;
+    bool m_fit = true;
+    QTimer m_anim;
+
+    // Waveform + loop markers, redrawn only when data/view/size change
+    QPixmap m_layer;
+    bool m_layerDirty = true;
+    double m_playPos = -1;
+
+    Drag m_drag = Drag::None;
+    double m_dragAnchor = 0;
 };
 #endif // WAVEFORMWIDGET_H
@@ -0,0 +1,147 @@
+#include "vag.h"
+#include "mappedfile.h"
+#include "wav.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+namespace fs = std::filesystem;
+
+// A VAG carries no root key, a looping one's smpl chunk gets middle C
+static const u8 ROOT_KEY = 60;
+
+static inline u32 be32(const u8* p) {
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+bool VagReader::parse(const u8* data, size_t size, VagFile& out) {
+    if (size < HEADER_SIZE || std::memcmp(data, "VAGp", 4) != 0) return false;
+    out.version = be32(data + 4);
+    u32 dataSize = be32(data + 12);
+    out.sample_rate = be32(data + 16);
+    const char* name = reinterpret_cast<const char*>(data + 32);
+    out.name.assign(name, std::find(name, name + 16, '\0'));
+
+    // Some tools leave the size at zero or count the header in it, the file knows better
+    size_t avail = size - HEADER_SIZE;
+    size_t n = (dataSize == 0 || dataSize > avail) ? avail : dataSize;
+    out.adpcm = data + HEADER_SIZE;
+    out.size = n / 16 * 16;
+    return out.size != 0 && out.sample_rate != 0;
+}
+
+bool VagReader::decode_all(const std::vector<QString>& inputs, const QString& out_dir, VagBatchStats* stats, size_t threads) {
+    auto t0 = std::chrono::steady_clock::now();
+
+    struct Job {
+        fs::path src, dst;
+        u64 size;
+    };
+    auto isVag = [](const fs::path& p) {
+        std::string ext = p.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return ext == ".vag";
+    };
+
+    fs::path root(out_dir.toStdString());
+    std::vector<Job> jobs;
+    std::error_code ec;
+    for (const QString& in : inputs) {
+        fs::path p(in.toStdString());
+        if (!fs::is_directory(p, ec)) {
+            jobs.push_back({ p, (root / p.filename()).replace_extension(".wav"), fs::file_size(p, ec) });
+            continue;
+        }
+        fs::recursive_directory_iterator it(p, fs::directory_options::skip_permission_denied, ec), end;
+        for (; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec) || !isVag(it->path())) continue;
+            fs::path rel = it->path().lexically_relative(p);
+            jobs.push_back({ it->path(), (root / rel).replace_extension(".wav"), it->file_size(ec) });
+        }
+    }
+    if (jobs.empty()) {
+        LogErr("VAG decode: no .vag files");
+        return false;
+    }
+
+    // Same-named inputs from different places would land on one file from two tasks,
+    // later ones get a numbered name. Compared lowercased for case-insensitive filesystems.
+    std::set<std::string> taken;
+    auto key = [](const fs::path& p) {
+        std::string k = p.lexically_normal().string();
+        std::transform(k.begin(), k.end(), k.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return k;
+    };
+    size_t renamed = 0;
+    for (Job& j : jobs) {
+        fs::path dst = j.dst;
+        for (int n = 2; !taken.insert(key(dst)).second; ++n) {
+            dst = j.dst.parent_path() / (j.dst.stem().string() + "_" + std::to_string(n) + j.dst.extension().string());
+        }
+        if (dst != j.dst) ++renamed;
+        j.dst = dst;
+    }
+    if (renamed) LogInfo("VAG decode: " + std::to_string(renamed) + " inputs share a name with another, numbered");
+
+    // Directories up front, the tasks only write files
+    std::set<fs::path> dirs;
+    for (const Job& j : jobs) dirs.insert(j.dst.parent_path());
+    for (const fs::path& d : dirs) {
+        fs::create_directories(d, ec);
+        if (ec) {
+            LogErr("VAG decode: could not create " + d.string());
+            return false;
+        }
+    }
+
+    // Largest first so the pool drains evenly
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) { return a.size > b.size; });
+
+    std::atomic<bool> failed{false};
+    std::atomic<size_t> decoded{0}, skipped{0};
+    std::atomic<u64> written{0};
+    {
+        WorkerPool pool(threads);
+        for (const Job& j : jobs) {
+            pool.submit([&] {
+                if (failed) return;
+                MappedFile in;
+                VagFile vag;
+                if (!in.open(QString::fromStdWString(j.src.wstring())) || !parse(in.data(), in.size(), vag)) {
+                    LogErr("VAG decode: skipping " + j.src.string());
+                    ++skipped;
+                    return;
+                }
+                std::vector<u8> file;
+                WavWriter::render(file, vag.adpcm, vag.size, vag.sample_rate, ROOT_KEY);
+                std::ofstream out(j.dst, std::ios::binary);
+                out.write(reinterpret_cast<const char*>(file.data()), file.size());
+                if (!out) {
+                    LogErr("VAG decode: could not write " + j.dst.string());
+                    failed = true;
+                    return;
+                }
+                ++decoded;
+                written += file.size();
+            });
+        }
+        pool.wait_idle();
+    }
+    if (failed) return false;
+
+    if (stats) {
+        stats->decoded = decoded;
+        stats->skipped = skipped;
+        stats->wav_bytes = written;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LogInfo("VAG decode: " + std::to_string(decoded) + " files, " + std::to_string(written / 1024) + " KB in "
+            + std::to_string(secs) + " s, " + std::to_string(skipped) + " skipped");
+    return decoded > 0;
+}
@@ -0,0 +1,38 @@
+#ifndef VAG_H
+#define VAG_H
+
+#include "main.h"
+#include <QString>
+#include <string>
+#include <vector>
+
+// A standalone VAGp file: 48-byte header with big-endian fields, then the same ADPCM
+// a BD holds. Points into the buffer it was parsed from.
+struct VagFile {
+    u32 version = 0;
+    u32 sample_rate = 0;
+    std::string name;           // header name, up to 16 chars
+    const u8* adpcm = nullptr;
+    size_t size = 0;            // whole blocks, clamped to what the buffer holds
+};
+
+struct VagBatchStats {
+    size_t decoded = 0;
+    size_t skipped = 0;         // not VAGp or unreadable
+    u64 wav_bytes = 0;
+};
+
+class VagReader {
+public:
+    static const size_t HEADER_SIZE = 48;
+
+    // False if data does not start with a VAGp header
+    static bool parse(const u8* data, size_t size, VagFile& out);
+
+    // Every .vag among inputs (directories searched recursively) to WAV under out_dir,
+    // keeping the directory layout. Files are mapped rather than read and decoded on a
+    // worker pool, largest first.
+    static bool decode_all(const std::vector<QString>& inputs, const QString& out_dir, VagBatchStats* stats = nullptr, size_t threads = 0);
+};
+
+#endif // VAG_H
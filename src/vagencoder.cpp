@@ -0,0 +1,266 @@
+#include "vagencoder.h"
+#include "simd.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <cstring>
+
+// Hardware filter coefficients, /64 (the decoder's F0/F1 tables)
+static const int F0[] = { 0, 60, 115, 98, 122 };
+static const int F1[] = { 0, 0, -52, -55, -60 };
+
+static const int FILTERS = 5;
+static const int SHIFTS = 13;
+// Quality mode re-scores this many of the block's best candidates against the next block
+static const int LOOKAHEAD = 3;
+
+struct History {
+    s32 s1 = 0, s2 = 0;
+};
+
+static inline s32 clamp16(s32 v) {
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : v);
+}
+
+// One filter/shift over one block, exactly as the SPU2 decodes it. Returns the squared
+// error, advances h and stores the nibbles when asked.
+static u64 trial(const s16* x, int filter, int shift, History& h, u8* nibbles) {
+    int sh = 12 - shift;
+    s32 half = sh > 0 ? 1 << (sh - 1) : 0;
+    u64 err = 0;
+    for (int i = 0; i < 28; ++i) {
+        s32 pred = (h.s1 * F0[filter] + h.s2 * F1[filter] + 32) >> 6;
+        s32 q = (x[i] - pred + half) >> sh;
+        q = q < -8 ? -8 : (q > 7 ? 7 : q);
+        s32 d = clamp16(pred + q * (1 << sh));
+        s64 e = x[i] - d;
+        err += (u64)(e * e);
+        h.s2 = h.s1;
+        h.s1 = d;
+        if (nibbles) nibbles[i] = (u8)(q & 0x0F);
+    }
+    return err;
+}
+
+static void search_scalar(const s16* x, const History& h, u64 err[FILTERS][SHIFTS]) {
+    for (int f = 0; f < FILTERS; ++f) {
+        for (int s = 0; s < SHIFTS; ++s) {
+            History t = h;
+            err[f][s] = trial(x, f, s, t, nullptr);
+        }
+    }
+}
+
+#if PS2SND_SSE2
+// Squared 32-bit differences into two u64 accumulators, exact like the scalar path
+static inline void accumulate_sq(__m128i diff, __m128i& acc_even, __m128i& acc_odd) {
+    __m128i sign = _mm_srai_epi32(diff, 31);
+    __m128i ad = _mm_sub_epi32(_mm_xor_si128(diff, sign), sign);
+    acc_even = _mm_add_epi64(acc_even, _mm_mul_epu32(ad, ad));
+    __m128i odd = _mm_srli_epi64(ad, 32);
+    acc_odd = _mm_add_epi64(acc_odd, _mm_mul_epu32(odd, odd));
+}
+
+// s32 lanes -> clamped to s16 and back, sign extended
+static inline __m128i sat16(__m128i v) {
+    __m128i p = _mm_packs_epi32(v, v);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(p, p), 16);
+}
+
+// Per shift, filters 1-4 run side by side in the four lanes (the recursion is per lane,
+// the shift is shared so one shift count covers the vector). Filter 0 has no history so
+// its block goes four samples at a time instead.
+static void search(const s16* x, const History& h, u64 err[FILTERS][SHIFTS]) {
+    alignas(16) s32 x32[28];
+    for (int i = 0; i < 28; ++i) x32[i] = x[i];
+
+    // (f0, f1) pairs for filters 1-4, for madd against interleaved (s1, s2)
+    const __m128i coef = _mm_setr_epi16((s16)F0[1], (s16)F1[1], (s16)F0[2], (s16)F1[2],
+                                        (s16)F0[3], (s16)F1[3], (s16)F0[4], (s16)F1[4]);
+    const __m128i round = _mm_set1_epi32(32);
+    const __m128i qmin = _mm_set1_epi16(-8), qmax = _mm_set1_epi16(7);
+    alignas(16) u64 acc[4];
+
+    for (int s = 0; s < SHIFTS; ++s) {
+        int sh = 12 - s;
+        const __m128i cnt = _mm_cvtsi32_si128(sh);
+        const __m128i half = _mm_set1_epi32(sh > 0 ? 1 << (sh - 1) : 0);
+
+        // Filter 0
+        __m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128();
+        for (int i = 0; i < 28; i += 4) {
+            __m128i xv = _mm_load_si128((const __m128i*)(x32 + i));
+            __m128i q = _mm_sra_epi32(_mm_add_epi32(xv, half), cnt);
+            __m128i q16 = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(q, q), qmax), qmin);
+            q = _mm_srai_epi32(_mm_unpacklo_epi16(q16, q16), 16);
+            accumulate_sq(_mm_sub_epi32(xv, _mm_sll_epi32(q, cnt)), even, odd);
+        }
+        _mm_store_si128((__m128i*)acc, _mm_add_epi64(even, odd));
+        err[0][s] = acc[0] + acc[1];
+
+        // Filters 1-4
+        __m128i s1 = _mm_set1_epi32(h.s1), s2 = _mm_set1_epi32(h.s2);
+        even = odd = _mm_setzero_si128();
+        for (int i = 0; i < 28; ++i) {
+            __m128i xv = _mm_set1_epi32(x32[i]);
+            __m128i hist = _mm_unpacklo_epi16(_mm_packs_epi32(s1, s1), _mm_packs_epi32(s2, s2));
+            __m128i pred = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(hist, coef), round), 6);
+            __m128i q = _mm_sra_epi32(_mm_add_epi32(_mm_sub_epi32(xv, pred), half), cnt);
+            __m128i q16 = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(q, q), qmax), qmin);
+            q = _mm_srai_epi32(_mm_unpacklo_epi16(q16, q16), 16);
+            __m128i d = sat16(_mm_add_epi32(pred, _mm_sll_epi32(q, cnt)));
+            accumulate_sq(_mm_sub_epi32(xv, d), even, odd);
+            s2 = s1;
+            s1 = d;
+        }
+        // even holds lanes 0/2 (filters 1/3), odd lanes 1/3 (filters 2/4)
+        _mm_store_si128((__m128i*)acc, even);
+        _mm_store_si128((__m128i*)(acc + 2), odd);
+        err[1][s] = acc[0];
+        err[3][s] = acc[1];
+        err[2][s] = acc[2];
+        err[4][s] = acc[3];
+    }
+}
+#else
+static void search(const s16* x, const History& h, u64 err[FILTERS][SHIFTS]) {
+    search_scalar(x, h, err);
+}
+#endif
+
+struct Candidate {
+    u64 err;
+    int filter, shift;
+};
+
+// The n best of a search, ties to the lower filter/shift so the result is stable
+static int best(const u64 err[FILTERS][SHIFTS], Candidate* out, int n) {
+    int count = 0;
+    for (int f = 0; f < FILTERS; ++f) {
+        for (int s = 0; s < SHIFTS; ++s) {
+            Candidate c{ err[f][s], f, s };
+            int pos = count < n ? count++ : n;
+            while (pos > 0 && c.err < out[pos - 1].err) {
+                if (pos < n) out[pos] = out[pos - 1];
+                --pos;
+            }
+            if (pos < n) out[pos] = c;
+        }
+    }
+    return count;
+}
+
+// Classic quick pick: filter with the smallest peak residual against the source itself,
+// shift just wide enough for that peak
+static Candidate pick_fast(const s16* x, const History& h) {
+    Candidate c{ 0, 0, 12 };
+    s32 bestPeak = 0x7FFFFFFF;
+    for (int f = 0; f < FILTERS; ++f) {
+        s32 p1 = h.s1, p2 = h.s2, peak = 0;
+        for (int i = 0; i < 28; ++i) {
+            s32 r = x[i] - ((p1 * F0[f] + p2 * F1[f] + 32) >> 6);
+            peak = std::max(peak, r < 0 ? -r : r);
+            p2 = p1;
+            p1 = x[i];
+        }
+        if (peak < bestPeak) {
+            bestPeak = peak;
+            c.filter = f;
+        }
+    }
+    int sh = 0;
+    while (sh < 12 && (bestPeak >> sh) > 7) ++sh;
+    c.shift = 12 - sh;
+    return c;
+}
+
+static Candidate pick_quality(const s16* x, const s16* next, const History& h) {
+    u64 err[FILTERS][SHIFTS];
+    search(x, h, err);
+    Candidate top[LOOKAHEAD];
+    int n = best(err, top, LOOKAHEAD);
+    if (!next) return top[0];
+
+    Candidate pick = top[0];
+    u64 pickScore = ~0ull;
+    for (int k = 0; k < n; ++k) {
+        // What this choice leaves in the history decides how well the next block can do
+        History t = h;
+        trial(x, top[k].filter, top[k].shift, t, nullptr);
+        u64 nextErr[FILTERS][SHIFTS];
+        search(next, t, nextErr);
+        Candidate nb;
+        best(nextErr, &nb, 1);
+        u64 score = top[k].err + nb.err;
+        if (score < pickScore) {
+            pickScore = score;
+            pick = top[k];
+        }
+    }
+    return pick;
+}
+
+std::vector<u8> VagEncoder::encode(const s16* pcm, size_t count, Mode mode, bool looping, u32 loop_start, u32 loop_end) {
+    if (looping && (loop_end > count || loop_start >= loop_end)) looping = false;
+
+    // Block-aligned source: loop start on a block boundary, loop end rounded up by
+    // continuing from the loop start, everything else zero padded
+    std::vector<s16> src;
+    u32 loopBlock = 0;
+    if (looping) {
+        u32 lead = (28 - loop_start % 28) % 28;
+        src.assign(lead, 0);
+        src.insert(src.end(), pcm, pcm + loop_end);
+        loopBlock = (loop_start + lead) / 28;
+        for (u32 k = 0; src.size() % 28; ++k) src.push_back(pcm[loop_start + k % (loop_end - loop_start)]);
+    } else {
+        src.assign(pcm, pcm + count);
+        while (src.size() % 28 || src.empty()) src.push_back(0);
+    }
+
+    size_t blocks = src.size() / 28;
+    std::vector<u8> out(blocks * 16, 0);
+    History h;
+    u8 nib[28];
+
+    for (size_t b = 0; b < blocks; ++b) {
+        const s16* x = src.data() + b * 28;
+        const s16* next = b + 1 < blocks ? x + 28 : nullptr;
+        Candidate c = mode == Fast ? pick_fast(x, h) : pick_quality(x, next, h);
+        trial(x, c.filter, c.shift, h, nib);
+
+        u8* blk = out.data() + b * 16;
+        blk[0] = (u8)((c.filter << 4) | c.shift);
+        u8 flags = 0;
+        if (looping) {
+            if (b >= loopBlock) flags |= 2;
+            if (b == loopBlock) flags |= 4;
+            if (b + 1 == blocks) flags |= 1;
+        } else if (b + 1 == blocks) {
+            flags = 1;
+        }
+        blk[1] = flags;
+        for (int i = 0; i < 14; ++i) blk[2 + i] = (u8)(nib[i * 2] | (nib[i * 2 + 1] << 4));
+    }
+    return out;
+}
+
+std::vector<u8> VagEncoder::encode(const DecodedSample& sample, Mode mode) {
+    if (!sample.pcm) return {};
+    return encode(sample.pcm->data(), sample.pcm->size(), mode, sample.looping, sample.loop_start, sample.loop_end);
+}
+
+std::vector<std::vector<u8>> VagEncoder::encode_all(const std::vector<DecodedSample>& samples, Mode mode, size_t threads) {
+    std::vector<std::vector<u8>> out(samples.size());
+    WorkerPool pool(threads);
+    // Longest first so one big sample does not start last and hold up the batch
+    std::vector<size_t> order(samples.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    auto len = [&](size_t i) { return samples[i].pcm ? samples[i].pcm->size() : 0; };
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return len(a) > len(b); });
+
+    for (size_t i : order) {
+        pool.submit([&, i] { out[i] = encode(samples[i], mode); });
+    }
+    pool.wait_idle();
+    return out;
+}
@@ -0,0 +1,30 @@
+#ifndef VAGENCODER_H
+#define VAGENCODER_H
+
+#include "main.h"
+#include "bd.h"
+#include <vector>
+
+// PCM -> SPU2 ADPCM, the inverse of AdpcmDecoder. Each 28-sample block picks one of the
+// 5 prediction filters and 13 shifts; the search simulates the hardware decoder (integer
+// prediction, clamped history) so what it measures is what the SPU2 will play.
+class VagEncoder {
+public:
+    enum Mode {
+        Fast,    // filter from the unquantized residual peak, one shift, one trial encode
+        Quality, // all 65 filter/shift pairs per block, best few re-scored one block ahead
+    };
+
+    // Looping samples get the loop start moved onto a block boundary (zeros in front) and
+    // the loop padded to whole blocks from its own start; the tail after loop_end is dropped.
+    // Flags: 6 on the loop start block, 2 inside the loop, 3 on the last block, or a
+    // plain 1 on the last block when not looping.
+    static std::vector<u8> encode(const s16* pcm, size_t count, Mode mode = Quality,
+                                  bool looping = false, u32 loop_start = 0, u32 loop_end = 0);
+    static std::vector<u8> encode(const DecodedSample& sample, Mode mode = Quality);
+
+    // Independent samples on a worker pool, results in input order
+    static std::vector<std::vector<u8>> encode_all(const std::vector<DecodedSample>& samples, Mode mode = Quality, size_t threads = 0);
+};
+
+#endif // VAGENCODER_H
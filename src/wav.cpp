@@ -0,0 +1,89 @@
+#include "wav.h"
+#include "bd.h"
+#include <cstring>
+#include <fstream>
+
+static void put16(u8*& p, u16 v) {
+    p[0] = (u8)v;
+    p[1] = (u8)(v >> 8);
+    p += 2;
+}
+
+static void put32(u8*& p, u32 v) {
+    put16(p, (u16)v);
+    put16(p, (u16)(v >> 16));
+}
+
+static void tag(u8*& p, const char* t) {
+    std::memcpy(p, t, 4);
+    p += 4;
+}
+
+void WavWriter::render(std::vector<u8>& out, const u8* adpcm, size_t size, u32 sample_rate, u8 root_key) {
+    AdpcmDecoder dec(adpcm, size, sample_rate);
+    const DecodedSample& lay = dec.info();
+    u32 frames = (u32)dec.total_samples();
+    u32 dataBytes = frames * (u32)sizeof(s16);
+    bool loop = lay.looping && lay.loop_end > lay.loop_start;
+    u32 smplBytes = loop ? 36 + 24 : 0;
+    u32 headerBytes = 12 + (8 + 16) + (loop ? 8 + smplBytes : 0) + 8;
+
+    out.resize(headerBytes + dataBytes);
+    u8* p = out.data();
+
+    tag(p, "RIFF");
+    put32(p, (u32)out.size() - 8);
+    tag(p, "WAVE");
+
+    tag(p, "fmt ");
+    put32(p, 16);
+    put16(p, 1); // PCM
+    put16(p, 1); // mono
+    put32(p, sample_rate);
+    put32(p, sample_rate * 2);
+    put16(p, 2);
+    put16(p, 16);
+
+    if (loop) {
+        tag(p, "smpl");
+        put32(p, smplBytes);
+        put32(p, 0); // manufacturer
+        put32(p, 0); // product
+        put32(p, sample_rate ? 1000000000u / sample_rate : 0);
+        put32(p, root_key > 0 ? root_key : 60);
+        put32(p, 0); // pitch fraction
+        put32(p, 0); // SMPTE format
+        put32(p, 0); // SMPTE offset
+        put32(p, 1); // loops
+        put32(p, 0); // sampler data
+        put32(p, 0); // cue id
+        put32(p, 0); // forward
+        put32(p, lay.loop_start);
+        put32(p, lay.loop_end - 1); // inclusive
+        put32(p, 0);
+        put32(p, 0); // infinite
+    }
+
+    tag(p, "data");
+    put32(p, dataBytes);
+
+    // PCM is little-endian like the host, decode right into the file image
+    dec.decode(reinterpret_cast<s16*>(p), frames / 28);
+}
+
+bool WavWriter::write(const std::string& path, const u8* adpcm, size_t size, u32 sample_rate, u8 root_key) {
+    std::vector<u8> file;
+    render(file, adpcm, size, sample_rate, root_key);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        LogErr("WAV: could not open " + path);
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(file.data()), file.size());
+    if (!out) {
+        LogErr("WAV: write failed for " + path);
+        return false;
+    }
+    return true;
+}
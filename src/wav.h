@@ -0,0 +1,18 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include "main.h"
+#include <string>
+#include <vector>
+
+// Mono 16-bit WAV straight from ADPCM. Looping samples get a smpl chunk so samplers
+// pick up the loop and root key.
+class WavWriter {
+public:
+    // Whole file into out (replacing it), decoded straight into place
+    static void render(std::vector<u8>& out, const u8* adpcm, size_t size, u32 sample_rate, u8 root_key);
+    // render + one write, so many small files cost one syscall each
+    static bool write(const std::string& path, const u8* adpcm, size_t size, u32 sample_rate, u8 root_key);
+};
+
+#endif // WAV_H
@@ -0,0 +1,103 @@
+#include "wavextract.h"
+#include "samplestore.h"
+#include "wav.h"
+#include "workerpool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+bool WavExtractor::extract(const QString& dir, const std::vector<ExportBank>& banks, ExportStats* stats, size_t threads) {
+    auto t0 = std::chrono::steady_clock::now();
+
+    SampleStore store;
+    std::unordered_map<const BDParser*, u16> bankOf;
+    std::map<u16, const BDParser*> numbered;
+    for (const ExportBank& b : banks) {
+        // Names carry the number, two banks under one would write the same files at once
+        if (!numbered.emplace(b.number, b.bd).second) {
+            LogErr("WAV extract: more than one bank numbered " + std::to_string(b.number));
+            return false;
+        }
+        bankOf.emplace(b.bd, b.number);
+        // One boundary scan per offset, tones pointing past the BD are left out
+        std::unordered_map<u32, SampleSpan> spans;
+        for (const auto& prog : b.bank->programs) {
+            for (const Tone& t : prog->tones) {
+                auto sp = spans.find(t.bd_offset);
+                if (sp == spans.end()) sp = spans.emplace(t.bd_offset, b.bd->scan_sample(t.bd_offset)).first;
+                if (sp->second.size) store.add(*b.bd, t, sp->second);
+            }
+        }
+    }
+    if (store.size() == 0) {
+        LogErr("WAV extract: no samples");
+        return false;
+    }
+
+    fs::path root(dir.toStdString());
+    std::error_code ec;
+    fs::create_directories(root, ec);
+    if (ec) {
+        LogErr("WAV extract: could not create " + root.string());
+        return false;
+    }
+
+    // Names by location, the rate only where a location is played at more than one
+    std::map<std::pair<u16, u32>, u32> rates;
+    for (u32 i = 0; i < store.size(); ++i) rates[{ bankOf[store.entry(i).bd], store.entry(i).offset }]++;
+    std::vector<std::string> names(store.size());
+    for (u32 i = 0; i < store.size(); ++i) {
+        const SampleStore::Entry& e = store.entry(i);
+        u16 bank = bankOf[e.bd];
+        char name[64];
+        if (rates[{ bank, e.offset }] > 1) std::snprintf(name, sizeof(name), "b%03u_%08x_%u.wav", bank, e.offset, e.sample_rate);
+        else std::snprintf(name, sizeof(name), "b%03u_%08x.wav", bank, e.offset);
+        names[i] = (root / name).string();
+    }
+
+    // Largest first so the pool drains evenly; each task renders in memory and writes once
+    std::vector<u32> order(store.size());
+    for (u32 i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return store.entry(a).size > store.entry(b).size; });
+
+    std::atomic<bool> failed{false};
+    std::atomic<u64> written{0};
+    {
+        WorkerPool pool(threads);
+        for (u32 i : order) {
+            pool.submit([&, i] {
+                if (failed) return;
+                const SampleStore::Entry& e = store.entry(i);
+                std::vector<u8> file;
+                WavWriter::render(file, e.bd->bytes(e.offset), e.size, e.sample_rate, e.root_key);
+                std::ofstream out(names[i], std::ios::binary);
+                out.write(reinterpret_cast<const char*>(file.data()), file.size());
+                if (!out) {
+                    LogErr("WAV extract: could not write " + names[i]);
+                    failed = true;
+                    return;
+                }
+                written += file.size();
+            });
+        }
+        pool.wait_idle();
+    }
+    if (failed) return false;
+
+    if (stats) {
+        stats->samples = store.size();
+        stats->duplicates = store.duplicates();
+        stats->bytes_saved = store.saved_bytes();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    LogInfo("WAV extract: " + std::to_string(store.size()) + " files, " + std::to_string(written / 1024) + " KB in "
+            + std::to_string(secs) + " s, " + std::to_string(store.duplicates()) + " duplicates skipped");
+    return true;
+}
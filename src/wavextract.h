@@ -0,0 +1,18 @@
+#ifndef WAVEXTRACT_H
+#define WAVEXTRACT_H
+
+#include "main.h"
+#include "exportplan.h"
+#include <QString>
+#include <vector>
+
+// Every distinct sample of the banks as its own WAV, b<bank>_<offset>.wav at the rate
+// the tones play it (a _<rate> suffix when one offset is used at several), loops in a
+// smpl chunk. Decoding and writing run on a worker pool, each file goes out in one write.
+// Bank numbers must be distinct.
+class WavExtractor {
+public:
+    static bool extract(const QString& dir, const std::vector<ExportBank>& banks, ExportStats* stats = nullptr, size_t threads = 0);
+};
+
+#endif // WAVEXTRACT_H
@@ -0,0 +1,56 @@
+#include "workerpool.h"
+
+WorkerPool::WorkerPool(size_t count) {
+    if (count == 0) count = std::thread::hardware_concurrency();
+    if (count == 0) count = 1;
+    for (size_t i = 0; i < count; ++i)
+        threads.emplace_back(&WorkerPool::loop, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void WorkerPool::submit(std::function<void()> fn, int priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push({ priority, next_seq++, std::move(fn) });
+    }
+    cv.notify_one();
+}
+
+void WorkerPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks = {};
+    if (active == 0) idle_cv.notify_all();
+}
+
+void WorkerPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this] { return tasks.empty() && active == 0; });
+}
+
+void WorkerPool::loop() {
+    while (true) {
+        std::function<void()> fn;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return quit || !tasks.empty(); });
+            if (quit) return;
+            fn = std::move(const_cast<Task&>(tasks.top()).fn);
+            tasks.pop();
+            active++;
+        }
+
+        fn();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+        if (active == 0 && tasks.empty()) idle_cv.notify_all();
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads pulling from a priority queue. Higher priority runs first,
+// equal priorities run in submission order.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads = 0); // 0 = one per core
+    ~WorkerPool();
+
+    void submit(std::function<void()> fn, int priority = 0);
+    // Drops everything still queued, running tasks finish normally
+    void clear();
+    // Blocks until the queue is empty and no task is running
+    void wait_idle();
+
+    size_t size() const { return threads.size(); }
+
+private:
+    struct Task {
+        int priority;
+        unsigned long long seq;
+        std::function<void()> fn;
+        bool operator<(const Task& o) const {
+            if (priority != o.priority) return priority < o.priority;
+            return seq > o.seq;
+        }
+    };
+
+    void loop();
+
+    std::vector<std::thread> threads;
+    std::priority_queue<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable idle_cv;
+    unsigned long long next_seq = 0;
+    size_t active = 0;
+    bool quit = false;
+};
+
+#endif // WORKERPOOL_H
@@ -0,0 +1,189 @@
+#include "workspace.h"
+#include "bdcarver.h"
+#include "imagescan.h"
+#include "mappedfile.h"
+#include "vag.h"
+#include <cstdio>
+#include <cstring>
+#include <QFileInfo>
+
+int Workspace::add(const QString& hd_path, const QString& bd_path) {
+    auto lb = std::make_unique<LoadedBank>();
+    lb->name = QFileInfo(hd_path).fileName();
+    lb->hd_path = hd_path;
+    lb->bd_path = bd_path;
+
+    if (!lb->bd.load(bd_path)) return -1;
+    HDParser hd;
+    if (!hd.load(hd_path, lb->bank)) return -1;
+    return insert(std::move(lb));
+}
+
+int Workspace::add_carved(const QString& bd_path, u32 sample_rate) {
+    auto lb = std::make_unique<LoadedBank>();
+    lb->name = QFileInfo(bd_path).fileName() + " (carved)";
+    lb->bd_path = bd_path;
+
+    if (!lb->bd.load(bd_path)) return -1;
+    lb->bank = BdCarver::make_bank(BdCarver::scan(lb->bd), sample_rate);
+    if (!lb->bank.valid) {
+        LogErr("Workspace: nothing that looks like ADPCM in " + bd_path.toStdString());
+        return -1;
+    }
+    return insert(std::move(lb));
+}
+
+int Workspace::add_image(const QString& path) {
+    // Banks read their BD straight from the mapping, the last one closed unmaps it
+    auto image = std::make_shared<MappedFile>();
+    if (!image->open(path)) return -1;
+
+    int added = 0;
+    for (ImageBank& ib : ImageScanner::scan(image->data(), image->size())) {
+        char at[32];
+        std::snprintf(at, sizeof(at), " @ 0x%08llx", (unsigned long long)ib.hd_offset);
+        if (!ib.bd_size) {
+            LogErr("Workspace: no BD found for the HD" + std::string(at));
+            continue;
+        }
+        auto lb = std::make_unique<LoadedBank>();
+        lb->name = QFileInfo(path).fileName() + at;
+        lb->hd_path = path;
+        lb->bd_path = path;
+        lb->bank = std::move(ib.bank);
+        lb->bd.view(image, image->data() + ib.bd_offset, ib.bd_size);
+        insert(std::move(lb));
+        ++added;
+    }
+    return added;
+}
+
+int Workspace::add_vags(const std::vector<QString>& paths) {
+    std::vector<u8> adpcm;
+    std::vector<CarvedSample> found;
+    for (const QString& path : paths) {
+        MappedFile in;
+        VagFile vag;
+        if (!in.open(path) || !VagReader::parse(in.data(), in.size(), vag)) {
+            LogErr("Workspace: not a VAG file, " + path.toStdString());
+            continue;
+        }
+        bool looping = AdpcmDecoder(vag.adpcm, vag.size, vag.sample_rate).info().looping;
+        found.push_back({ (u32)adpcm.size(), (u32)vag.size, looping, vag.sample_rate });
+        adpcm.insert(adpcm.end(), vag.adpcm, vag.adpcm + vag.size);
+        // Every reader bounds a sample by its end flag, not by a size. Not all VAG writers
+        // set one, and without it this sample would run on into the next file's.
+        adpcm[adpcm.size() - 15] |= 1;
+    }
+    if (found.empty()) return -1;
+
+    auto lb = std::make_unique<LoadedBank>();
+    lb->name = paths.size() == 1 ? QFileInfo(paths[0]).fileName() : QString::number(found.size()) + " VAG files";
+    lb->bd_path = paths[0];
+    lb->bd.assign(std::move(adpcm));
+    lb->bank = BdCarver::make_bank(found, 44100, "VAG");
+    return insert(std::move(lb));
+}
+
+int Workspace::insert(std::unique_ptr<LoadedBank> lb) {
+    // Boundary scan + content hash, once per distinct offset however many tones share it
+    for (const auto& prog : lb->bank.programs) {
+        for (const auto& tone : prog->tones) {
+            if (lb->samples.count(tone.bd_offset)) continue;
+            SampleSpan span = lb->bd.scan_sample(tone.bd_offset);
+            lb->samples[tone.bd_offset] = span;
+            lb->content[tone.bd_offset] = content_id(lb->bd, span);
+        }
+    }
+
+    u32 no = (u32)banks.size();
+    idx.add_bank(no, lb->bank, lb->samples);
+    banks.push_back(std::move(lb));
+
+    LogInfo("Workspace: bank " + std::to_string(no) + ", " + std::to_string(idx.size()) + " tones indexed, "
+            + std::to_string(contents.size()) + " distinct samples, " + std::to_string(dup_bytes) + " duplicate PCM bytes");
+    return (int)no;
+}
+
+void Workspace::clear() {
+    banks.clear();
+    idx.clear();
+    contents.clear();
+    by_hash.clear();
+    dup_bytes = 0;
+}
+
+u32 Workspace::content_id(const BDParser& bd, const SampleSpan& span) {
+    auto range = by_hash.equal_range(span.hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Content& c = contents[it->second];
+        if (c.size == span.size && (span.size == 0 || std::memcmp(c.bd->bytes(c.offset), bd.bytes(span.offset), span.size) == 0)) {
+            dup_bytes += (u64)span.size / 16 * 28 * sizeof(s16);
+            return it->second;
+        }
+    }
+    u32 id = (u32)contents.size();
+    contents.push_back({ &bd, span.offset, span.size });
+    by_hash.emplace(span.hash, id);
+    return id;
+}
+
+u64 Workspace::content_key(u32 bank_no, u32 offset) const {
+    // Top bit set, sample keys never get there (bank numbers stay far below 2^31)
+    if (bank_no < banks.size()) {
+        auto it = banks[bank_no]->content.find(offset);
+        if (it != banks[bank_no]->content.end()) return (1ull << 63) | it->second;
+    }
+    return sample_key(bank_no, offset);
+}
+
+std::shared_ptr<const Program> Workspace::program(u32 bank_no, u32 prog_id) const {
+    if (bank_no >= banks.size()) return nullptr;
+    for (const auto& p : banks[bank_no]->bank.programs) {
+        if (p->id == prog_id) return p;
+    }
+    return nullptr;
+}
+
+const Tone* Workspace::tone(u32 bank_no, u32 prog_id, int tone_idx) const {
+    auto prog = program(bank_no, prog_id);
+    if (!prog || tone_idx < 0 || tone_idx >= (int)prog->tones.size()) return nullptr;
+    return &prog->tones[tone_idx];
+}
+
+bool Workspace::edit_tone(u32 bank_no, u32 prog_id, int tone_idx, const Tone& tone) {
+    const Tone* old = this->tone(bank_no, prog_id, tone_idx);
+    if (!old || old->bd_offset != tone.bd_offset) return false;
+
+    LoadedBank& lb = *banks[bank_no];
+    Bank next;
+    if (!BankHistory::with_tone(lb.bank, prog_id, (size_t)tone_idx, tone, next)) return false;
+    lb.history.apply(lb.bank, std::move(next));
+    reindex(bank_no);
+    return true;
+}
+
+bool Workspace::edit_program(u32 bank_no, u32 prog_id, u8 master_vol, u8 master_pan) {
+    if (bank_no >= banks.size()) return false;
+    LoadedBank& lb = *banks[bank_no];
+    Bank next;
+    if (!BankHistory::with_program(lb.bank, prog_id, master_vol, master_pan, next)) return false;
+    lb.history.apply(lb.bank, std::move(next));
+    return true;
+}
+
+bool Workspace::undo(u32 bank_no) {
+    if (bank_no >= banks.size() || !banks[bank_no]->history.undo(banks[bank_no]->bank)) return false;
+    reindex(bank_no);
+    return true;
+}
+
+bool Workspace::redo(u32 bank_no) {
+    if (bank_no >= banks.size() || !banks[bank_no]->history.redo(banks[bank_no]->bank)) return false;
+    reindex(bank_no);
+    return true;
+}
+
+void Workspace::reindex(u32 bank_no) {
+    idx.update_bank(bank_no, banks[bank_no]->bank);
+}
@@ -0,0 +1,91 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "main.h"
+#include "hd.h"
+#include "bd.h"
+#include "toneindex.h"
+#include "bankhistory.h"
+#include <QString>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct LoadedBank {
+    QString name; // HD file name, for display
+    QString hd_path;
+    QString bd_path;
+    Bank bank;      // current version, history holds the others
+    BankHistory history;
+    BDParser bd;
+    std::unordered_map<u32, SampleSpan> samples; // by offset, one per distinct offset the HD uses
+    std::unordered_map<u32, u32> content;        // by offset, the Workspace content id there
+};
+
+// Every bank open in the window, plus the search index over all of them.
+// Banks never move once added, so their BD stays valid for background decoders
+// until clear().
+class Workspace {
+public:
+    // Loads the pair and appends it. Returns the bank number, -1 if either file failed.
+    int add(const QString& hd_path, const QString& bd_path);
+    // A BD on its own, samples found by BdCarver (no hd_path, nothing to save back)
+    int add_carved(const QString& bd_path, u32 sample_rate);
+    // Every HD/BD pair ImageScanner finds in a disc image or archive, read straight from
+    // the mapped file (it stays mapped while any of them is open, nothing is copied). Returns how many were added (appended in image order), -1 if the
+    // file failed.
+    int add_image(const QString& path);
+    // Standalone .vag files as one bank, their ADPCM back to back in memory, each at
+    // its own rate on its own key (as a carved bank). Files that are not VAGp are skipped.
+    int add_vags(const std::vector<QString>& paths);
+    void clear();
+
+    size_t size() const { return banks.size(); }
+    bool empty() const { return banks.empty(); }
+    const LoadedBank& bank(size_t i) const { return *banks[i]; }
+
+    std::shared_ptr<const Program> program(u32 bank_no, u32 prog_id) const;
+    // Valid until the bank is edited again
+    const Tone* tone(u32 bank_no, u32 prog_id, int tone_idx) const;
+
+    // Edits go through the bank's history and the search index follows them.
+    // A tone keeps its sample, bd_offset cannot change here.
+    bool edit_tone(u32 bank_no, u32 prog_id, int tone_idx, const Tone& tone);
+    bool edit_program(u32 bank_no, u32 prog_id, u8 master_vol, u8 master_pan);
+    bool undo(u32 bank_no);
+    bool redo(u32 bank_no);
+
+    const ToneIndex& index() const { return idx; }
+
+    // Location of a sample, offsets alone collide across banks
+    static u64 sample_key(u32 bank_no, u32 offset) { return ((u64)bank_no << 32) | offset; }
+    // Identity of what is stored there, the same data anywhere in the workspace shares it.
+    // Never equal to a sample_key().
+    u64 content_key(u32 bank_no, u32 offset) const;
+
+    // Distinct ADPCM runs across every bank, and the PCM bytes that repeats of them
+    // would have cost if decoded/exported separately
+    size_t distinct_samples() const { return contents.size(); }
+    u64 duplicate_bytes() const { return dup_bytes; }
+
+private:
+    int insert(std::unique_ptr<LoadedBank> lb);
+    // Tone ids stay put, edits never add or remove tones
+    void reindex(u32 bank_no);
+
+    std::vector<std::unique_ptr<LoadedBank>> banks;
+    // Content ids, confirmed byte for byte: equal hashes only make two runs candidates
+    struct Content {
+        const BDParser* bd;
+        u32 offset;
+        u32 size;
+    };
+    u32 content_id(const BDParser& bd, const SampleSpan& span);
+
+    ToneIndex idx;
+    std::vector<Content> contents;
+    std::unordered_multimap<u64, u32> by_hash;
+    u64 dup_bytes = 0;
+};
+
+#endif // WORKSPACE_H